@@ -0,0 +1,766 @@
+// ============================================================================
+// bench.c - BFS benchmarks
+// ============================================================================
+
+#include <pthread.h>
+
+#include "bfs.h"
+#include "bench.h"
+#include "deb.h"
+#include "defrag.h"
+#include "fs.h"
+#include "gen.h"
+#include "hist.h"
+#include "prof.h"
+#include "res.h"
+#include "stats.h"
+
+static u32 g_benchRand = 1;             // xorshift32 state; never 0
+
+typedef struct {                        // BenchMdArg: one benchMeta thread
+  i32 id;
+  i32 files;                            // # directory entries it owns
+  i32 iters;
+} BenchMdArg;
+
+static pthread_barrier_t g_benchBarrier;        // starts and ends each phase
+static str g_benchMdNames[NUMBENCHMD] = {
+  "create", "close", "open", "stat", "close", "delete"
+};
+
+
+
+// ============================================================================
+// Return the number of metadata (non-data) bio calls counted in 'st'
+// ============================================================================
+static u64 benchMetaIO(IOStats* st) {
+  u64 n = 0;
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    for (i32 bc = 0; bc < NUMBC; ++bc) {
+      if (bc == BCDATA) continue;
+      n += st->io[op][bc][IOREAD] + st->io[op][bc][IOWRITE];
+    }
+  }
+  return n;
+}
+
+
+
+// ============================================================================
+// Return the number of blocks on the Freelist, from the allocation counters.
+// Assumes the counters were reset just after fsFormat
+// ============================================================================
+static i32 benchFree() {
+  IOStats st;
+  statsGet(&st);
+  return BLOCKSPERDISK - NUMMETA - (i32)(st.allocs - st.frees);
+}
+
+
+
+// ============================================================================
+// Read every file in 'names' front to back, checking its contents against
+// 'data', then read 'numRnd' single blocks picked at random.  Add the time
+// of each pass to 'ns', and the bio calls of each to 'io'.  Return the number
+// of bytes that did not match
+// ============================================================================
+static i32 benchReadBack(char names[][FNAMESIZE], i8** data, i32* size,
+                         i32 num, i32 numRnd, u64 ns[2], u64 io[2]) {
+  i8  buf[BYTESPERBLOCK];
+  i32 bad = 0;
+
+  for (i32 pass = 0; pass < 2; ++pass) {
+    FsStats before;
+    fsGetStats(&before);
+    u64 t0 = histNow();
+
+    if (pass == 0) {
+      for (i32 i = 0; i < num; ++i) {
+        i32 fd = fsOpen(names[i]);
+        for (i32 off = 0; off < size[i]; off += BYTESPERBLOCK) {
+          i32 n = fsRead(fd, BYTESPERBLOCK, buf);
+          for (i32 b = 0; b < n; ++b) bad += (buf[b] != data[i][off + b]);
+        }
+        fsClose(fd);
+      }
+    } else {
+      i32 fds[NUMINODES];
+      for (i32 i = 0; i < num; ++i) fds[i] = fsOpen(names[i]);
+      for (i32 r = 0; r < numRnd; ++r) {
+        i32 i = benchRand() % num;
+        if (size[i] < BYTESPERBLOCK) continue;
+        fsSeek(fds[i], (benchRand() % (size[i] / BYTESPERBLOCK)) *
+          BYTESPERBLOCK, SEEK_SET);
+        fsRead(fds[i], BYTESPERBLOCK, buf);
+      }
+      for (i32 i = 0; i < num; ++i) fsClose(fds[i]);
+    }
+
+    ns[pass] += histNow() - t0;
+    FsStats after;
+    fsGetStats(&after);
+    io[pass] += after.bioReads - before.bioReads;
+  }
+  return bad;
+}
+
+
+
+// ============================================================================
+// Aging benchmark.  Age a fresh disk through 'steps' random operations:
+// create a file, append 1 to 4 blocks to one, overwrite a block of one, or
+// delete one.  Then read back the files that survive, sequentially and at
+// random: on the aged disk, after the online defragmenter has run on it,
+// after the offline one has too, and on a fresh disk where the same files
+// were written one after another.  Print, for each, how fragmented the
+// files are and what the reads cost
+// ============================================================================
+i32 benchAging(i32 steps, u32 seed) {
+  str oldDisk = bioDisk();
+  bioSetDisk(BENCHDISK);
+  fsFormat();
+  fsMount();
+  statsReset();
+  benchSeed(seed);
+
+  i32  fds[NUMINODES];
+  char names[NUMINODES][FNAMESIZE];
+  for (i32 i = 0; i < NUMINODES; ++i) {
+    fds[i] = -1;
+    sprintf(names[i], "A%d", i);
+  }
+
+  i8 buf[BYTESPERBLOCK];
+  for (i32 s = 0; s < steps; ++s) {
+    i32 i  = benchRand() % NUMINODES;
+    i32 op = benchRand() % 100;
+    memset(buf, (i8)s, BYTESPERBLOCK);
+
+    if (fds[i] < 0) {                           // 'create' when i is free
+      if (op < 30) fds[i] = fsCreate(names[i]);
+    } else if (op < 55) {                       // append
+      i32 k = 1 + benchRand() % 4;
+      fsSeek(fds[i], 0, SEEK_END);
+      for (i32 b = 0; b < k && benchFree() > BENCHRESERVE; ++b) {
+        fsWrite(fds[i], BYTESPERBLOCK, buf);
+      }
+    } else if (op < 85) {                       // overwrite
+      i32 blocks = fsSize(fds[i]) / BYTESPERBLOCK;
+      if (blocks > 0) {
+        fsSeek(fds[i], (benchRand() % blocks) * BYTESPERBLOCK, SEEK_SET);
+        fsWrite(fds[i], BYTESPERBLOCK, buf);
+      }
+    } else {                                    // delete
+      fsClose(fds[i]);
+      fsDelete(names[i]);
+      fds[i] = -1;
+    }
+  }
+
+  char live[NUMINODES][FNAMESIZE];              // the survivors, and their
+  i8*  data[NUMINODES];                         // contents
+  i32  size[NUMINODES];
+  i32  num = 0;
+  for (i32 i = 0; i < NUMINODES; ++i) {
+    if (fds[i] < 0) continue;
+    size[num] = fsSize(fds[i]);
+    data[num] = malloc(size[num] + 1);
+    if (data[num] == NULL) FATAL(ENOMEM);
+    fsSeek(fds[i], 0, SEEK_SET);
+    if (size[num] > 0) fsRead(fds[i], size[num], data[num]);
+    fsClose(fds[i]);
+    strcpy(live[num++], names[i]);
+  }
+
+  printf("\n%-7s %5s %6s %12s %9s %9s %9s %7s %7s \n", "disk", "files",
+    "blocks", "extents/file", "mean-seek", "seq-us", "rnd-us", "seq-io",
+    "rnd-io");
+
+  str disks[] = { "aged", "online", "offline", "fresh" };
+  for (i32 pass = 0; pass < 4; ++pass) {
+    DefragReport rep;
+    if (pass == 1) defragOnline(0, &rep);
+    if (pass == 2) {
+      defragOffline(&rep);
+      fsMount();
+    }
+    if (pass == 3) {
+      fsFormat();
+      fsMount();
+      for (i32 i = 0; i < num; ++i) {
+        i32 fd = fsCreate(live[i]);
+        for (i32 off = 0; off < size[i]; off += BYTESPERBLOCK) {
+          i32 n = size[i] - off;
+          fsWrite(fd, n < BYTESPERBLOCK ? n : BYTESPERBLOCK, data[i] + off);
+        }
+        fsClose(fd);
+      }
+    }
+
+    i32 blocks  = 0;
+    i32 extents = 0;
+    i64 seek    = 0;
+    for (i32 i = 0; i < num; ++i) {
+      Layout lay;
+      i32 inum = bfsLookupFile(live[i]);
+      debFileLayout(inum, &lay);
+      bfsDerefOFT(inum);
+      blocks  += lay.blocks;
+      extents += lay.extents;
+      seek    += lay.seek;
+    }
+
+    u64 ns[2] = {0};
+    u64 io[2] = {0};
+    benchSeed(seed);
+    i32 bad = benchReadBack(live, data, size, num, 4 * blocks, ns, io);
+    if (bad != 0) printf("%d bytes read back wrong \n", bad);
+
+    str    disk = disks[pass];
+    double nb   = (blocks > 0) ? blocks : 1;
+    double nf   = (num    > 0) ? num    : 1;
+    printf("%-7s %5d %6d %12.2f %9.2f %9.2f %9.2f %7.2f %7.2f \n", disk, num,
+      blocks, extents / nf, (double)seek / nb, ns[0] / nb / 1e3,
+      ns[1] / (4 * nb) / 1e3, io[0] / nb, io[1] / (4 * nb));
+
+    char config[RESNAMESIZE];
+    sprintf(config, "%s-%d", disk, steps);
+    resAdd("aging", config, "extents-file", RESLOWER, extents / nf);
+    resAdd("aging", config, "seq-us",       RESLOWER, ns[0] / nb / 1e3);
+    resAdd("aging", config, "rnd-us",       RESLOWER, ns[1] / (4 * nb) / 1e3);
+  }
+  printf("(per block read; seek in blocks between successive blocks) \n\n");
+  fflush(stdout);
+
+  for (i32 i = 0; i < num; ++i) free(data[i]);
+  remove(BENCHDISK);
+  bioSetDisk(oldDisk);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Allocator benchmark.  Age a fresh disk through 'cycles' rounds of: create
+// any missing files; grow all files, one block at a time in random order,
+// until the disk is full; delete a random half of the files.  Files that
+// survive keep growing next round, into the holes left by those deleted.
+// For each round, report allocation rate, metadata I/Os per allocation and
+// how fragmented the files ended up.  Add the totals, and the fragmentation
+// after the last round, to the results (see res.h)
+// ============================================================================
+i32 benchAlloc(i32 cycles, u32 seed) {
+  str oldDisk = bioDisk();
+  bioSetDisk(BENCHDISK);
+  fsFormat();
+  fsMount();
+  statsReset();
+  benchSeed(seed);
+
+  i32  fds[NUMINODES];
+  char names[NUMINODES][FNAMESIZE];
+  for (i32 i = 0; i < NUMINODES; ++i) {
+    fds[i] = -1;
+    sprintf(names[i], "F%d", i);
+  }
+
+  i8 buf[BYTESPERBLOCK];
+  memset(buf, 0xAB, BYTESPERBLOCK);
+
+  u64 totAllocs = 0;
+  u64 totMeta   = 0;
+  u64 totNs     = 0;
+  i32 blocks    = 0;
+  i32 extents   = 0;
+
+  printf("\n%5s %7s %10s %10s %6s %12s %8s %5s \n", "cycle", "allocs",
+    "allocs/s", "meta/alloc", "files", "extents/file", "run-len", "free");
+
+  for (i32 c = 0; c < cycles; ++c) {
+    for (i32 i = 0; i < NUMINODES; ++i) {
+      if (fds[i] < 0) fds[i] = fsCreate(names[i]);
+    }
+
+    IOStats before;
+    statsGet(&before);
+    u64 ns = 0;
+
+    while (benchFree() > BENCHRESERVE) {
+      i32 i = benchRand() % NUMINODES;
+      fsSeek(fds[i], 0, SEEK_END);
+      u64 t0 = histNow();
+      fsWrite(fds[i], BYTESPERBLOCK, buf);
+      ns += histNow() - t0;
+    }
+
+    IOStats after;
+    statsGet(&after);
+    u64 allocs = after.allocs - before.allocs;
+    u64 meta   = benchMetaIO(&after) - benchMetaIO(&before);
+
+    totAllocs += allocs;
+    totMeta   += meta;
+    totNs     += ns;
+
+    blocks  = 0;
+    extents = 0;
+    for (i32 i = 0; i < NUMINODES; ++i) {
+      Layout lay;
+      debFileLayout(bfsFdToInum(fds[i]), &lay);
+      blocks  += lay.blocks;
+      extents += lay.extents;
+    }
+
+    printf("%5d %7llu %10.0f %10.2f %6d %12.2f %8.2f %5d \n", c,
+      (unsigned long long)allocs,
+      ns > 0 ? allocs / (ns / 1e9) : 0.0,
+      allocs > 0 ? (double)meta / allocs : 0.0,
+      NUMINODES,
+      (double)extents / NUMINODES,
+      extents > 0 ? (double)blocks / extents : 0.0,
+      benchFree());
+
+    for (i32 i = 0; i < NUMINODES; ++i) {
+      if (benchRand() % 2 == 0) continue;
+      fsClose(fds[i]);
+      fsDelete(names[i]);
+      fds[i] = -1;
+    }
+  }
+  printf("\n"); fflush(stdout);
+
+  char config[RESNAMESIZE];
+  sprintf(config, "%d-cycles", cycles);
+  resAdd("alloc", config, "allocs-per-s", RESHIGHER,
+    totNs > 0 ? totAllocs / (totNs / 1e9) : 0.0);
+  resAdd("alloc", config, "meta-per-alloc", RESLOWER,
+    totAllocs > 0 ? (double)totMeta / totAllocs : 0.0);
+  resAdd("alloc", config, "extents-file", RESLOWER,
+    (double)extents / NUMINODES);
+  resAdd("alloc", config, "run-len", RESHIGHER,
+    extents > 0 ? (double)blocks / extents : 0.0);
+
+  for (i32 i = 0; i < NUMINODES; ++i) {
+    if (fds[i] >= 0) fsClose(fds[i]);
+  }
+  remove(BENCHDISK);
+  bioSetDisk(oldDisk);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Backend benchmark.  For every bio backend, with no block cache and with two
+// cache sizes, format a fresh disk and run the same workloads:
+//
+//   seqwr  write a BENCHBLOCKS-block file front to back, then bioSync
+//   seqrd  read it front to back
+//   rndrd  read single blocks at random offsets
+//   rndwr  overwrite single blocks at random offsets, then bioSync
+//   meta   create, close, open, close and delete BENCHMETA small files
+//
+// each 'rounds' times over.  Print one row per configuration: microseconds
+// per block (per file, for meta), blocks the backend moved, and cache hits.
+// Add the same numbers to the results (see res.h)
+// ============================================================================
+i32 benchBackends(i32 rounds, u32 seed) {
+  static i32 caches[] = { 0, 16, 64 };
+  i32 numCaches = sizeof(caches) / sizeof(caches[0]);
+
+  if (rounds < 1) rounds = 1;
+  str oldDisk = bioDisk();
+  bioSetDisk(BENCHDISK);
+
+  i8 buf[BYTESPERBLOCK];
+  memset(buf, 0xAB, BYTESPERBLOCK);
+
+  char names[BENCHMETA][FNAMESIZE];
+  for (i32 i = 0; i < BENCHMETA; ++i) sprintf(names[i], "M%d", i);
+
+  printf("\n%-7s %5s %8s %8s %8s %8s %8s %9s %6s \n", "backend", "cache",
+    "seqwr", "seqrd", "rndrd", "rndwr", "meta", "dev-io", "hit");
+
+  for (i32 b = 0; b < NUMBIO; ++b) {
+    for (i32 c = 0; c < numCaches; ++c) {
+      bioSetBackend(BIOSTDIO);
+      bioSetCache(caches[c]);
+      fsFormat();
+      fsMount();
+      printf("%-7s %5d", bioBackendName(b), caches[c]);
+      if (bioSetBackend(b) != 0) { printf(" %8s \n", "n/a"); continue; }
+      statsReset();
+      benchSeed(seed);
+
+      u64 ns[5] = {0};
+      i32 fd = fsCreate("SEQ");
+      u64 t0 = histNow();
+      for (i32 r = 0; r < rounds; ++r) {
+        fsSeek(fd, 0, SEEK_SET);
+        for (i32 i = 0; i < BENCHBLOCKS; ++i) fsWrite(fd, BYTESPERBLOCK, buf);
+      }
+      bioSync();
+      ns[0] = histNow() - t0;
+
+      t0 = histNow();
+      for (i32 r = 0; r < rounds; ++r) {
+        fsSeek(fd, 0, SEEK_SET);
+        for (i32 i = 0; i < BENCHBLOCKS; ++i) fsRead(fd, BYTESPERBLOCK, buf);
+      }
+      ns[1] = histNow() - t0;
+
+      t0 = histNow();
+      for (i32 i = 0; i < rounds * BENCHBLOCKS; ++i) {
+        fsSeek(fd, (benchRand() % BENCHBLOCKS) * BYTESPERBLOCK, SEEK_SET);
+        fsRead(fd, BYTESPERBLOCK, buf);
+      }
+      ns[2] = histNow() - t0;
+
+      t0 = histNow();
+      for (i32 i = 0; i < rounds * BENCHBLOCKS; ++i) {
+        fsSeek(fd, (benchRand() % BENCHBLOCKS) * BYTESPERBLOCK, SEEK_SET);
+        fsWrite(fd, BYTESPERBLOCK, buf);
+      }
+      bioSync();
+      ns[3] = histNow() - t0;
+      fsClose(fd);
+
+      t0 = histNow();
+      for (i32 r = 0; r < rounds; ++r) {
+        for (i32 i = 0; i < BENCHMETA; ++i) {
+          fsClose(fsCreate(names[i]));
+          fsClose(fsOpen(names[i]));
+          fsDelete(names[i]);
+        }
+      }
+      ns[4] = histNow() - t0;
+
+      FsStats st;
+      fsGetStats(&st);
+      double blocks = (double)rounds * BENCHBLOCKS;
+      double files  = (double)rounds * BENCHMETA;
+
+      char config[RESNAMESIZE];
+      sprintf(config, "%s/%d", bioBackendName(b), caches[c]);
+      resAdd("backends", config, "seqwr-us", RESLOWER, ns[0] / blocks / 1e3);
+      resAdd("backends", config, "seqrd-us", RESLOWER, ns[1] / blocks / 1e3);
+      resAdd("backends", config, "rndrd-us", RESLOWER, ns[2] / blocks / 1e3);
+      resAdd("backends", config, "rndwr-us", RESLOWER, ns[3] / blocks / 1e3);
+      resAdd("backends", config, "meta-us",  RESLOWER, ns[4] / files  / 1e3);
+      resAdd("backends", config, "dev-io",   RESLOWER,
+        (double)(st.devReads + st.devWrites));
+
+      printf(" %8.2f %8.2f %8.2f %8.2f %8.2f %9llu", ns[0] / blocks / 1e3,
+        ns[1] / blocks / 1e3, ns[2] / blocks / 1e3, ns[3] / blocks / 1e3,
+        ns[4] / files / 1e3,
+        (unsigned long long)(st.devReads + st.devWrites));
+      if (caches[c] == 0) { printf(" %6s \n", "-"); continue; }
+
+      double hit = 100.0 * st.cacheHits / (st.cacheHits + st.cacheMisses);
+      printf(" %5.1f%% \n", hit);
+      resAdd("backends", config, "hit-pct", RESHIGHER, hit);
+    }
+  }
+  printf("(microseconds per block; meta per file) \n\n"); fflush(stdout);
+
+  bioSetBackend(BIOSTDIO);
+  bioSetCache(0);
+  remove(BENCHDISK);
+  bioSetDisk(oldDisk);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Run metadata phase 'phase' over the 'files' files owned by thread 'id'.
+// 'fds' holds their file descriptors between phases
+// ============================================================================
+static void benchMdPhase(i32 phase, i32 id, i32 files, i32* fds) {
+  for (i32 i = 0; i < files; ++i) {
+    char name[FNAMESIZE];
+    sprintf(name, "T%dF%d", id, i);
+    switch (phase) {
+      case BENCHMDCREATE: fds[i] = fsCreate(name); break;
+      case BENCHMDOPEN:   fds[i] = fsOpen(name);   break;
+      case BENCHMDSTAT:   fsSize(fds[i]);          break;
+      case BENCHMDDELETE: fsDelete(name);          break;
+      default:            fsClose(fds[i]);         break;
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Body of each benchMeta thread: every phase of every iteration, in step
+// with the others through g_benchBarrier
+// ============================================================================
+static void* benchMdThread(void* p) {
+  BenchMdArg* arg = (BenchMdArg*)p;
+  i32 fds[NUMINODES];
+  for (i32 it = 0; it < arg->iters; ++it) {
+    for (i32 phase = 0; phase < NUMBENCHMD; ++phase) {
+      pthread_barrier_wait(&g_benchBarrier);
+      benchMdPhase(phase, arg->id, arg->files, fds);
+      pthread_barrier_wait(&g_benchBarrier);
+    }
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Metadata benchmark, in the style of mdtest.  Threads each own a share of
+// the directory, and together create, close, open, stat (fsSize), close
+// and delete all their files, phase by phase, 'iters' times over.  For each
+// mix of thread count and directory entries, print the rate of each call
+// and the bio calls each create, open and delete issues: every one of
+// them scans the Dir block from disk.  BFS has NUMINODES directory
+// entries, so that bounds the directory sizes tried
+// ============================================================================
+i32 benchMeta(i32 iters) {
+  static i32 mixes[][2] = {             // threads, entries per thread
+    { 1, 1 }, { 1, 2 }, { 1, 4 }, { 1, 8 }, { 2, 4 }, { 4, 2 }
+  };
+  i32 numMixes = sizeof(mixes) / sizeof(mixes[0]);
+
+  if (iters < 1) iters = 1;
+  str oldDisk = bioDisk();
+  bioSetDisk(BENCHDISK);
+
+  printf("\n%7s %7s %10s %10s %10s %10s %10s %7s %7s %7s \n", "threads",
+    "entries", "create/s", "open/s", "stat/s", "close/s", "delete/s",
+    "cr-io", "op-io", "del-io");
+
+  for (i32 m = 0; m < numMixes; ++m) {
+    i32 threads = mixes[m][0];
+    i32 files   = mixes[m][1];
+    fsFormat();
+    fsMount();
+    statsReset();
+
+    pthread_t  tid[NUMINODES];
+    BenchMdArg arg[NUMINODES];
+    pthread_barrier_init(&g_benchBarrier, NULL, threads + 1);
+    for (i32 t = 0; t < threads; ++t) {
+      arg[t].id    = t;
+      arg[t].files = files;
+      arg[t].iters = iters;
+      pthread_create(&tid[t], NULL, benchMdThread, &arg[t]);
+    }
+
+    u64 ns[NUMBENCHMD] = {0};
+    u64 io[NUMBENCHMD] = {0};
+    for (i32 it = 0; it < iters; ++it) {
+      for (i32 phase = 0; phase < NUMBENCHMD; ++phase) {
+        FsStats before;
+        fsGetStats(&before);
+        u64 t0 = histNow();                     // before the release: on
+        pthread_barrier_wait(&g_benchBarrier);  // one CPU, the workers may
+        pthread_barrier_wait(&g_benchBarrier);  // run before we resume
+        ns[phase] += histNow() - t0;
+
+        FsStats after;
+        fsGetStats(&after);
+        io[phase] += (after.bioReads  + after.bioWrites)
+                   - (before.bioReads + before.bioWrites);
+      }
+    }
+    for (i32 t = 0; t < threads; ++t) pthread_join(tid[t], NULL);
+    pthread_barrier_destroy(&g_benchBarrier);
+
+    ns[BENCHMDCLOSE] += ns[BENCHMDCLOSE2];
+    io[BENCHMDCLOSE] += io[BENCHMDCLOSE2];
+
+    double ops = (double)iters * threads * files;
+    char config[RESNAMESIZE];
+    sprintf(config, "t%d-e%d", threads, threads * files);
+    printf("%7d %7d", threads, threads * files);
+    for (i32 phase = 0; phase < NUMBENCHMD; ++phase) {
+      if (phase == BENCHMDCLOSE2) continue;
+      double n    = (phase == BENCHMDCLOSE) ? 2 * ops : ops;
+      double rate = n / (ns[phase] / 1e9);
+      printf(" %10.0f", rate);
+
+      char metric[RESNAMESIZE];
+      sprintf(metric, "%s-per-s", g_benchMdNames[phase]);
+      resAdd("meta", config, metric, RESHIGHER, rate);
+    }
+    printf(" %7.2f %7.2f %7.2f \n", io[BENCHMDCREATE] / ops,
+      io[BENCHMDOPEN] / ops, io[BENCHMDDELETE] / ops);
+    resAdd("meta", config, "create-io", RESLOWER, io[BENCHMDCREATE] / ops);
+    resAdd("meta", config, "open-io",   RESLOWER, io[BENCHMDOPEN]   / ops);
+    resAdd("meta", config, "delete-io", RESLOWER, io[BENCHMDDELETE] / ops);
+  }
+  printf("(calls per second; bio calls per create, open and delete) \n\n");
+  fflush(stdout);
+
+  remove(BENCHDISK);
+  bioSetDisk(oldDisk);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Startup benchmark.  For volumes filled to several levels, 'rounds' times
+// each: time fsFormat; fill the volume round-robin across NUMINODES files;
+// restart cold (see bioEvict) and time fsMount to the first successful
+// fsOpen, then the first fsRead; then time one pass reading every file,
+// which warms a block cache big enough for the whole volume, and a second
+// pass, which runs hot.  BFS volumes are a fixed BLOCKSPERDISK blocks, so
+// it is the fill level, not the image size, that varies
+// ============================================================================
+i32 benchMount(i32 rounds) {
+  static i32 fills[] = { 0, 25, 50, 75, 90 };   // % of the free blocks
+  i32 numFills = sizeof(fills) / sizeof(fills[0]);
+
+  if (rounds < 1) rounds = 1;
+  str oldDisk = bioDisk();
+  bioSetDisk(BENCHDISK);
+  bioSetCache(BLOCKSPERDISK);
+
+  i8 buf[BYTESPERBLOCK];
+  char names[NUMINODES][FNAMESIZE];             // as genImage names them
+  for (i32 i = 0; i < NUMINODES; ++i) sprintf(names[i], "F%d", i);
+
+  printf("\n%5s %6s %10s %10s %10s %10s %10s \n", "fill", "blocks",
+    "format-us", "mount-us", "first-us", "warm-us", "hot-us");
+
+  for (i32 f = 0; f < numFills; ++f) {
+    double sum[5] = {0};
+    i32    used   = 0;
+
+    for (i32 r = 0; r < rounds; ++r) {
+      u64 ns[5];
+      u64 t0 = histNow();
+      fsFormat();
+      bioSync();
+      ns[0] = histNow() - t0;
+
+      GenSpec spec = { NUMINODES, 0, 0, GENUNIFORM, 0, GENFBN, r + 1 };
+      spec.minSize = fills[f] * (BLOCKSPERDISK - NUMMETA) / 100 / NUMINODES
+                   * BYTESPERBLOCK;
+      spec.maxSize = spec.minSize;
+      used = genImage(BENCHDISK, &spec);
+
+      bioEvict();                               // restart: nothing cached,
+      bfsInitOFT();                             // nothing open
+
+      t0 = histNow();
+      fsMount();
+      i32 fd = fsOpen(names[0]);
+      ns[1] = histNow() - t0;
+
+      t0 = histNow();
+      fsRead(fd, BYTESPERBLOCK, buf);
+      ns[2] = histNow() - t0;
+      fsClose(fd);
+
+      for (i32 pass = 3; pass <= 4; ++pass) {
+        t0 = histNow();
+        for (i32 i = 0; i < NUMINODES; ++i) {
+          fd = fsOpen(names[i]);
+          while (fsRead(fd, BYTESPERBLOCK, buf) > 0) { }
+          fsClose(fd);
+        }
+        ns[pass] = histNow() - t0;
+      }
+
+      char config[RESNAMESIZE];
+      sprintf(config, "fill%d", fills[f]);
+      resAdd("mount", config, "format-us", RESLOWER, ns[0] / 1e3);
+      resAdd("mount", config, "mount-us",  RESLOWER, ns[1] / 1e3);
+      resAdd("mount", config, "first-us",  RESLOWER, ns[2] / 1e3);
+      resAdd("mount", config, "warm-us",   RESLOWER, ns[3] / 1e3);
+      resAdd("mount", config, "hot-us",    RESLOWER, ns[4] / 1e3);
+      for (i32 i = 0; i < 5; ++i) sum[i] += ns[i] / 1e3;
+    }
+
+    printf("%4d%% %6d %10.1f %10.1f %10.1f %10.1f %10.1f \n", fills[f], used,
+      sum[0] / rounds, sum[1] / rounds, sum[2] / rounds, sum[3] / rounds,
+      sum[4] / rounds);
+  }
+  printf("(means over %d rounds; format writes all %d blocks) \n\n", rounds,
+    BLOCKSPERDISK);
+  fflush(stdout);
+
+  bioSetCache(0);
+  remove(BENCHDISK);
+  bioSetDisk(oldDisk);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Profile workload.  On a fresh disk, append 'blocks' whole blocks to a
+// file, overwrite it 100 bytes at a time at random offsets, read it back
+// block by block and then 100 bytes at a time at random, and open, size,
+// close and delete it.  Then print where each fs.h call spent its time, by
+// purpose and by layer (see profDump).  Needs BFS compiled with -DBFSPROF
+// ============================================================================
+i32 benchProfile(i32 blocks) {
+  i32 max = BLOCKSPERDISK - NUMMETA - BENCHRESERVE;
+  if (blocks < 1)   blocks = 1;
+  if (blocks > max) blocks = max;
+
+  str oldDisk = bioDisk();
+  bioSetDisk(BENCHDISK);
+  fsFormat();
+  fsMount();
+  profReset();
+  benchSeed(1);
+
+  i8 buf[BYTESPERBLOCK];
+  memset(buf, 0x5A, BYTESPERBLOCK);
+  i32 size = blocks * BYTESPERBLOCK;
+
+  i32 fd = fsCreate("PROF");
+  for (i32 b = 0; b < blocks; ++b) fsWrite(fd, BYTESPERBLOCK, buf);
+  for (i32 i = 0; i < 4 * blocks; ++i) {
+    fsSeek(fd, benchRand() % (size - 100), SEEK_SET);
+    fsWrite(fd, 100, buf);
+  }
+  fsSeek(fd, 0, SEEK_SET);
+  while (fsRead(fd, BYTESPERBLOCK, buf) > 0) { }
+  for (i32 i = 0; i < 4 * blocks; ++i) {
+    fsSeek(fd, benchRand() % (size - 100), SEEK_SET);
+    fsRead(fd, 100, buf);
+  }
+  fsClose(fd);
+  fd = fsOpen("PROF");
+  fsSize(fd);
+  fsClose(fd);
+  fsDelete("PROF");
+
+  if (profDump() == ENYI) {
+    printf("\nprofiling is off: rebuild BFS with -DBFSPROF \n\n");
+  }
+
+  remove(BENCHDISK);
+  bioSetDisk(oldDisk);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the next pseudo-random number.  Benchmarks use their own generator
+// so that a given seed always produces the same workload
+// ============================================================================
+u32 benchRand() {
+  return xorshift(&g_benchRand);
+}
+
+
+
+// ============================================================================
+// Restart the pseudo-random sequence from 'seed'
+// ============================================================================
+i32 benchSeed(u32 seed) {
+  g_benchRand = (seed == 0) ? 1 : seed;
+  return 0;
+}
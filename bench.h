@@ -0,0 +1,33 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// ===================================================================
+// bench.h - BFS benchmarks.  Each benchmark formats its own scratch
+// disk, BENCHDISK, and prints a table of results
+// ===================================================================
+
+#include "alias.h"
+
+#define BENCHDISK     "BENCHDISK"
+#define BENCHRESERVE  2           // free blocks kept back: 1 data, 1
+                                  // indirect
+#define BENCHBLOCKS   64          // blocks in the backend benchmark file
+#define BENCHMETA     6           // files churned by its metadata workload
+#define BENCHMDCREATE 0           // Metadata benchmark phases
+#define BENCHMDCLOSE  1
+#define BENCHMDOPEN   2
+#define BENCHMDSTAT   3
+#define BENCHMDCLOSE2 4           //   closes again, counted as BENCHMDCLOSE
+#define BENCHMDDELETE 5
+#define NUMBENCHMD    6
+
+i32 benchAging   (i32 steps,  u32 seed);
+i32 benchAlloc   (i32 cycles, u32 seed);
+i32 benchBackends(i32 rounds, u32 seed);
+i32 benchMeta    (i32 iters);
+i32 benchMount   (i32 rounds);
+i32 benchProfile (i32 blocks);
+u32 benchRand    ();
+i32 benchSeed    (u32 seed);
+
+#endif
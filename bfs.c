@@ -3,11 +3,16 @@
 // ============================================================================
 
 #include "bfs.h"
+#include "hook.h"
+#include "prof.h"
+#include "stats.h"
 
 // ============================================================================
 // Allocate a free disk block for the file whose Inode number is 'inum' and
-// assign it to FBN 'fbn' in the file's Inode.  On success, return the DBN
-// allocated.  On failure, abort
+// assign it to FBN 'fbn' in the file's Inode.  If 'fbn' needs an indirect
+// block the file does not have yet, allocate that too, starting it empty,
+// and record it in the Inode.  On success, return the DBN allocated.  On
+// failure, abort
 // ============================================================================
 i32 bfsAllocBlock(i32 inum, i32 fbn) {
 
@@ -16,6 +21,8 @@ i32 bfsAllocBlock(i32 inum, i32 fbn) {
   if (fbn  < 0)       FATAL(EBADFBN);
   if (fbn  > MAXFBN)  FATAL(EBADFBN);
 
+  PROFENTER(PROFBFS, PROFALLOC);
+
   // Grab the next free block in the BFS disk
 
   i32 dbn = bfsFindFreeBlock();
@@ -31,22 +38,27 @@ i32 bfsAllocBlock(i32 inum, i32 fbn) {
   if (fbn < NUMDIRECT) {                  // in direct[] array?
     pinode->direct[fbn] = dbn;
     bioWrite(DBNINODES, buf8);
+    PROFLEAVE();
     return dbn;
   } else {                                // in indirect block?
     i16 buf16[I16SPERBLOCK]= {0};
     i32 dbnIndirect = pinode->indirect;   // DBN of indirect block
 
-    if (dbnIndirect == 0) {               // not yet allocated
-      dbnIndirect = bfsFindFreeBlock();
-      pinode->indirect = dbn;
+    if (dbnIndirect == 0) {               // not yet allocated: its old
+      dbnIndirect = bfsFindFreeBlock();   // contents are a Freelist link,
+      pinode->indirect = dbnIndirect;     // so start from zeroes
+      bioWrite(DBNINODES, buf8);
+    } else {
+      statsClass(BCINDIRECT);
+      bioRead(dbnIndirect, buf16);
     }
 
-    bioRead(dbnIndirect, buf16);
-
     buf16[fbn - NUMDIRECT] = dbn;
+    statsClass(BCINDIRECT);
     bioWrite(dbnIndirect, buf16);
   }
 
+  PROFLEAVE();
   return dbn;                             // allocated DBN
 
 }
@@ -64,6 +76,7 @@ i32 bfsCreateFile(str fname) {
 
   if (strlen(fname) > FNAMESIZE - 1) FATAL(EBIGFNAME);  // fname too big
 
+  PROFENTER(PROFBFS, PROFMETA);
   i8 buf[BYTESPERBLOCK] = {0};
 
   bioRead(DBNDIR, buf);
@@ -75,6 +88,7 @@ i32 bfsCreateFile(str fname) {
       strcpy(dir->fname[inum], fname);
       bioWrite(DBNDIR, dir);
       bfsRefOFT(inum);
+      PROFLEAVE();
       return inum;
     }
   }
@@ -85,12 +99,76 @@ i32 bfsCreateFile(str fname) {
 
 
 
+// ============================================================================
+// Delete file 'fname': return its data blocks, and its indirect block, to the
+// Freelist, and clear its Inode and Directory entry.  On success, return 0.
+// If not found, return EFNF.  If still open, return EFILEOPEN
+// ============================================================================
+i32 bfsDeleteFile(str fname) {
+
+  if (fname == NULL) FATAL(ENULLPTR);
+
+  PROFENTER(PROFBFS, PROFMETA);
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioRead(DBNDIR, buf);
+  Dir* dir = (Dir*)buf;
+
+  i32 inum = 0;
+  while (inum < NUMINODES && strcmp(fname, dir->fname[inum]) != 0) ++inum;
+  if (inum == NUMINODES) {
+    PROFLEAVE();
+    return EFNF;
+  }
+
+  for (i32 i = 0; i < NUMOFTENTRIES; ++i) {
+    if (g_oft[i].inum == inum && g_oft[i].refs > 0) {
+      PROFLEAVE();
+      return EFILEOPEN;
+    }
+  }
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  // Only FBNs below EOF are mapped.  Slots beyond may hold stale DBNs
+
+  i32 numFbns = (inode.size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+
+  for (i32 fbn = 0; fbn < NUMDIRECT && fbn < numFbns; ++fbn) {
+    if (inode.direct[fbn] != 0) bfsFreeBlock(inode.direct[fbn]);
+  }
+
+  if (inode.indirect != 0) {
+    i16 buf16[I16SPERBLOCK] = {0};
+    statsClass(BCINDIRECT);
+    bioRead(inode.indirect, buf16);
+    for (i32 fbn = NUMDIRECT; fbn < numFbns && fbn < MAXFBN; ++fbn) {
+      i32 dbn = buf16[fbn - NUMDIRECT];
+      if (dbn >= MINDBN && dbn < BLOCKSPERDISK) bfsFreeBlock(dbn);
+    }
+    bfsFreeBlock(inode.indirect);
+  }
+
+  memset(&inode, 0, sizeof(Inode));
+  bfsWriteInode(inum, &inode);
+
+  memset(dir->fname[inum], 0, FNAMESIZE);
+  bioWrite(DBNDIR, buf);
+
+  PROFLEAVE();
+  return 0;
+}
+
+
+
 // ============================================================================
 // Dereference file with Inode number 'inum' in the Open File Table.  If
-// refcount reaches 0, free up that entry in the OFT
+// refcount reaches 0, free up that entry in the OFT.  If the file is not
+// open, leave the OFT alone and return EBADINUM
 // ============================================================================
 i32 bfsDerefOFT(i32 inum) {
   i32 ofte = bfsFindOFTE(inum);
+  if (g_oft[ofte].refs <= 0) return EBADINUM;   // a free slot: not open
   --g_oft[ofte].refs;
   if (g_oft[ofte].refs == 0) {
     g_oft[ofte].inum = 0;
@@ -102,14 +180,17 @@ i32 bfsDerefOFT(i32 inum) {
 
 
 // ============================================================================
-// Extend file 'inum' out to FBN 'fbn'
+// Extend file 'inum' out to FBN 'fbn'.  FBNs below EOF, including a part
+// filled last block, are already mapped
 // ============================================================================
 i32 bfsExtend(i32 inum, i32 fbn) {
+  PROFENTER(PROFBFS, PROFALLOC);
   i32 size = bfsGetSize(inum);
-  i32 fbnLast = (size + 1) / BYTESPERBLOCK;
+  i32 fbnLast = (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
   for (i32 f = fbnLast; f <= fbn; ++f) {
     bfsAllocBlock(inum, f);
   }
+  PROFLEAVE();
   return 0;
 }
 
@@ -117,7 +198,8 @@ i32 bfsExtend(i32 inum, i32 fbn) {
 
 // ============================================================================
 // Use Inode to find the DBN used to store file block 'fbn'.  Return ENODBN
-// if not yet mapped
+// if not yet mapped.  A lookup changes nothing: bfsAllocBlock makes the
+// indirect block, if need be, when the FBN is mapped
 // ============================================================================
 i32 bfsFbnToDbn(i32 inum, i32 fbn) {
 
@@ -126,32 +208,33 @@ i32 bfsFbnToDbn(i32 inum, i32 fbn) {
   if (fbn  < 0)       FATAL(EBADFBN);
   if (fbn  > MAXFBN)  FATAL(EBADFBN);
 
+  PROFENTER(PROFBFS, PROFMETA);
   Inode inode;
   
   bfsReadInode(inum, &inode);
 
   if (fbn < NUMDIRECT) {            // in direct[] array?
     i32 dbn = inode.direct[fbn];
+    PROFLEAVE();
     return (dbn == 0) ? ENODBN : dbn;
   }
 
   // fbn is not in direct, so check indirect block.  If it doesn't exist,
-  // then allocate an empty indirect block.  But return ENODBN for the
-  // caller to handle grabing a new data block.
+  // then nothing beyond the direct blocks is mapped yet
 
   if (inode.indirect == 0) {      // no indirect block yet allocated
-    i32 dbn = bfsFindFreeBlock();
-    inode.indirect = dbn;
-    bfsWriteInode(inum, &inode);
+    PROFLEAVE();
     return ENODBN;
   }
 
   // Check the indirect block
 
   i16 buf[NUMINDIRECT] = {0};
+  statsClass(BCINDIRECT);
   bioRead(inode.indirect, buf);
 
   i32 dbn = buf[fbn - NUMDIRECT];
+  PROFLEAVE();
   return (dbn == 0) ? ENODBN : dbn;
 }
 
@@ -170,21 +253,27 @@ i32 bfsFdToInum(i32 fd) {
 
 
 // ============================================================================
-// Find 'inum' in the Open File Table (OFT).  If not found, create an entry.
-// Return the index within the OFT.  On failure, EOFTFULL
+// Find 'inum' in the Open File Table (OFT).  If not found, create an entry,
+// with no references yet.  Return the index within the OFT.  On failure,
+// EOFTFULL.  An entry is in use while its refs is non-zero: inum 0 is a
+// valid file, so cannot mark a free slot
 // ============================================================================
 i32 bfsFindOFTE(i32 inum) {
   for (int i = 0; i < NUMOFTENTRIES; ++i) {
-    if (g_oft[i].inum == inum) return i;
+    if (g_oft[i].inum == inum && g_oft[i].refs > 0) {
+      HOOK(HKOFTLOOKUP, inum, i);
+      return i;
+    }
   }
   
   // Not found, so look for an empty OFTE
 
   for (int i = 0; i < NUMOFTENTRIES; ++i) {
-    if (g_oft[i].inum == 0) {
+    if (g_oft[i].refs == 0) {
       g_oft[i].inum = inum;
       g_oft[i].curs = 0;
-      g_oft[i].refs = 1;
+      g_oft[i].refs = 0;
+      HOOK(HKOFTLOOKUP, inum, i);
       return i;
     }
   }
@@ -199,6 +288,7 @@ i32 bfsFindOFTE(i32 inum) {
 // accordingly.  On success, return DBN.  FATAL otherwise
 // ============================================================================
 i32 bfsFindFreeBlock() {
+  PROFENTER(PROFBFS, PROFALLOC);
   i8 buf8[BYTESPERBLOCK] = {0};
   bioRead(DBNSUPER, buf8);
   Super* super = (Super*)buf8;
@@ -207,16 +297,50 @@ i32 bfsFindFreeBlock() {
   if (dbn == 0) FATAL(EDISKFULL);
 
   i16 buf16[I16SPERBLOCK] = {0};      // for next free block
+  statsClass(BCFREE);
   bioRead(dbn, buf16);
 
   super->firstFree = buf16[0];        // new head of Freelist
 
   bioWrite(DBNSUPER, buf8);           // update SuperBlock
+  statsAlloc();
+  HOOK(HKALLOC, dbn, 0);
 
+  PROFLEAVE();
   return dbn;
 }
 
 
+// ============================================================================
+// Return block 'dbn' to the head of the Freelist.  The block is zeroed, apart
+// from its link, so that it is clean when next allocated
+// ============================================================================
+i32 bfsFreeBlock(i32 dbn) {
+
+  if (dbn < MINDBN)        FATAL(EBADDBN);
+  if (dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  PROFENTER(PROFBFS, PROFALLOC);
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i16 buf16[I16SPERBLOCK] = {0};
+  buf16[0] = super->firstFree;        // link to old head of Freelist
+  statsClass(BCFREE);
+  bioWrite(dbn, buf16);
+
+  super->firstFree = dbn;             // new head of Freelist
+  bioWrite(DBNSUPER, buf8);
+  statsFree();
+  HOOK(HKFREE, dbn, 0);
+
+  PROFLEAVE();
+  return 0;
+}
+
+
+
 // ============================================================================
 // Initialize the Freelist
 // ============================================================================
@@ -226,10 +350,12 @@ i32 bfsInitFreeList() {
 
   for (int dbn = NUMMETA; dbn < BLOCKSPERDISK - 1; ++dbn) {
     buf[0] = dbn + 1;
+    statsClass(BCFREE);
     bioWrite(dbn, (i8*)buf);
   }
 
   buf[0] = 0;
+  statsClass(BCFREE);
   bioWrite(BLOCKSPERDISK - 1, (i8*)buf);      // end of Freelist
 
   return ret;
@@ -306,6 +432,7 @@ i32 bfsLookupFile(str fname) {
 
   if (fname == NULL) FATAL(ENULLPTR);
 
+  PROFENTER(PROFBFS, PROFMETA);
   i8 buf[BYTESPERBLOCK] = {0};
 
   bioRead(DBNDIR, buf);
@@ -315,10 +442,12 @@ i32 bfsLookupFile(str fname) {
   for (int inum = 0; inum < NUMINODES; ++inum) {
     if (strcmp(fname, dir->fname[inum]) == 0) {
       bfsRefOFT(inum);
+      PROFLEAVE();
       return inum;
     }
   }
 
+  PROFLEAVE();
   return EFNF;
 
 }
@@ -352,6 +481,7 @@ i32 bfsReadInode(i32 inum, Inode* inode) {
   if (inum > MAXINUM) FATAL(EBADINUM);
   if (inode == NULL)  FATAL(ENULLPTR);
 
+  PROFENTER(PROFBFS, PROFMETA);
   i8 buf[BYTESPERBLOCK] = {0};
 
   bioRead(DBNINODES, buf);
@@ -359,6 +489,8 @@ i32 bfsReadInode(i32 inum, Inode* inode) {
   Inode* inodes = (Inode*)buf;
 
   memcpy(inode, &inodes[inum], sizeof(Inode));
+  HOOK(HKINODEREAD, inum, inode->size);
+  PROFLEAVE();
   return 0;
 }
 
@@ -409,9 +541,11 @@ i32 bfsGetSize(i32 inum) {
   if (inum < 0)       FATAL(EBADINUM);
   if (inum > MAXINUM) FATAL(EBADINUM);
 
+  PROFENTER(PROFBFS, PROFMETA);
   Inode inode;
   bfsReadInode(inum, &inode);
 
+  PROFLEAVE();
   return inode.size;
 }
 
@@ -425,11 +559,13 @@ i32 bfsSetSize(i32 inum, i32 size) {
   if (inum < 0)       FATAL(EBADINUM);
   if (inum > MAXINUM) FATAL(EBADINUM);
 
+  PROFENTER(PROFBFS, PROFMETA);
   Inode inode;
   bfsReadInode(inum, &inode);
   
   inode.size = size;
   bfsWriteInode(inum, &inode);
+  PROFLEAVE();
   return 0;
 }
 
@@ -444,11 +580,14 @@ i32 bfsWriteInode(i32 inum, Inode* inode) {
   if (inum > MAXINUM) FATAL(EBADINUM);
   if (inode == NULL)  FATAL(ENULLPTR);
 
+  PROFENTER(PROFBFS, PROFMETA);
   i8 buf[BYTESPERBLOCK];
   bioRead(DBNINODES, buf);
   Inode* inodes = (Inode*)buf;
   memcpy(&inodes[inum], inode, sizeof(Inode));
   bioWrite(DBNINODES, buf);
+  HOOK(HKINODEWRITE, inum, inode->size);
+  PROFLEAVE();
 
   return 0;
 }
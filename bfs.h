@@ -67,12 +67,14 @@ OFTE g_oft[NUMOFTENTRIES];
 
 i32 bfsAllocBlock(i32 inum, i32 fbn);
 i32 bfsCreateFile(str fname);
+i32 bfsDeleteFile(str fname);
 i32 bfsDerefOFT(i32 inum);
 i32 bfsExtend(i32 inum, i32 fbn);
 i32 bfsFbnToDbn(i32 inum,   i32 fbn);
 i32 bfsFdToInum(i32 fd);
 i32 bfsFindFreeBlock();
 i32 bfsFindOFTE(i32 inum);
+i32 bfsFreeBlock(i32 dbn);
 i32 bfsGetSize(i32 inum);
 i32 bfsInitDir();
 i32 bfsInitFreeList();
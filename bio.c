@@ -2,48 +2,419 @@
 // bio.c - low level Block IO functions
 // ============================================================================
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "bfs.h"
 #include "bio.h"
+#include "blk.h"
+#include "dev.h"
+#include "hist.h"
+#include "hook.h"
+#include "prof.h"
+#include "stats.h"
+
+static str g_bioDisk = BFSDISK;         // path of the BFS disk image
+
+static i32             g_bioBackend = BIOSTDIO;
+static atomic_int      g_bioReady   = 0;     // dev holds the disk open
+static pthread_mutex_t g_bioLock    = PTHREAD_MUTEX_INITIALIZER;
+
+static str g_bioNames[NUMBIO] = {
+  "stdio", "pread", "mmap", "direct", "aio", "ram"
+};
+
+// The block cache is a fully associative LRU over slots.  s_cacheSlot maps
+// a DBN to its slot; slots are chained MRU-first through prev/next.  All of
+// it is guarded by g_bioLock
+
+static i32  g_cacheSize  = 0;           // # slots; 0 => no cache
+static i32  g_cacheUsed  = 0;           // # slots holding a block
+static i32  g_cacheDirty = 0;           // # slots not yet written back
+static i32  g_cacheHead  = -1;          // most recently used slot
+static i32  g_cacheTail  = -1;          // least recently used slot
+static i8*  s_cacheData  = NULL;        // g_cacheSize blocks
+static i32* s_cacheDbn   = NULL;        // DBN held by each slot
+static i32* s_cachePrev  = NULL;
+static i32* s_cacheNext  = NULL;
+static i8*  s_cacheDirty = NULL;        // 1 => slot differs from the disk
+static i32  s_cacheSlot[BLOCKSPERDISK]; // slot holding each DBN; -1 => none
+
+
+
+// ============================================================================
+// Return the printable name of bio backend 'backend'
+// ============================================================================
+str bioBackendName(i32 backend) {
+  if (backend < 0 || backend >= NUMBIO) return "?";
+  return g_bioNames[backend];
+}
+
+
+
+// ============================================================================
+// Open the disk image for the current backend, unless already open.  Called
+// with g_bioLock held.  Return 0, ENODISK, or ENOBACKEND
+// ============================================================================
+static i32 bioOpen() {
+  if (atomic_load(&g_bioReady)) return 0;
+
+  i32 ret = devOpen(g_bioDisk, g_bioBackend, BYTESPERDISK);
+  if (ret == DEVNODISK)    return ENODISK;
+  if (ret == DEVNOSUPPORT) return ENOBACKEND;
+
+  atomic_store(&g_bioReady, 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Make sure the disk image is open.  Cheap once it is.  Every bio call does
+// this before taking g_bioLock for the cache
+// ============================================================================
+static void bioReady() {
+  if (atomic_load_explicit(&g_bioReady, memory_order_acquire)) return;
+  pthread_mutex_lock(&g_bioLock);
+  i32 ret = bioOpen();
+  pthread_mutex_unlock(&g_bioLock);
+  if (ret != 0) FATAL(ret);
+}
+
+
+
+// ============================================================================
+// Move block 'dbn' between the disk image and 'buf' through the current
+// backend, which must be open.  'rw' is IOREAD or IOWRITE
+// ============================================================================
+static void bioDevIO(i32 dbn, void* buf, i32 rw) {
+  statsDev(rw);
+  PROFENTER(PROFDEV, PROFSAME);
+  i32 ret = devIO((i64)dbn * BYTESPERBLOCK, buf, BYTESPERBLOCK, rw);
+  PROFLEAVE();
+  if (ret == DEVNODISK) FATAL(ENODISK);
+  if (ret != 0)         FATAL(rw == IOREAD ? EBADREAD : EBADWRITE);
+}
+
+
+
+// ============================================================================
+// Unlink cache slot 's' from the LRU chain
+// ============================================================================
+static void bioCacheUnlink(i32 s) {
+  if (s_cachePrev[s] >= 0) s_cacheNext[s_cachePrev[s]] = s_cacheNext[s];
+  else                     g_cacheHead = s_cacheNext[s];
+  if (s_cacheNext[s] >= 0) s_cachePrev[s_cacheNext[s]] = s_cachePrev[s];
+  else                     g_cacheTail = s_cachePrev[s];
+}
+
+
+
+// ============================================================================
+// Move block 'dbn' between the block cache and 'buf'.  A read miss fills a
+// slot from the backend; a write only marks its slot dirty.  Evicting a
+// dirty slot writes it back first
+// ============================================================================
+static void bioCacheIO(i32 dbn, void* buf, i32 rw) {
+  PROFENTER(PROFCACHE, PROFSAME);
+  pthread_mutex_lock(&g_bioLock);
+
+  i32 s   = s_cacheSlot[dbn];
+  i32 hit = (s >= 0);
+
+  if (hit) {
+    bioCacheUnlink(s);
+  } else {
+    if (g_cacheUsed < g_cacheSize) {
+      s = g_cacheUsed++;
+    } else {
+      s = g_cacheTail;
+      bioCacheUnlink(s);
+      if (s_cacheDirty[s]) {
+        bioDevIO(s_cacheDbn[s], s_cacheData + s * BYTESPERBLOCK, IOWRITE);
+        s_cacheDirty[s] = 0;
+        --g_cacheDirty;
+      }
+      s_cacheSlot[s_cacheDbn[s]] = -1;
+    }
+    s_cacheSlot[dbn] = s;
+    s_cacheDbn[s]    = dbn;
+    if (rw == IOREAD) bioDevIO(dbn, s_cacheData + s * BYTESPERBLOCK, IOREAD);
+  }
+
+  s_cachePrev[s] = -1;                          // relink as MRU
+  s_cacheNext[s] = g_cacheHead;
+  if (g_cacheHead >= 0) s_cachePrev[g_cacheHead] = s; else g_cacheTail = s;
+  g_cacheHead = s;
+
+  i8* data = s_cacheData + s * BYTESPERBLOCK;
+  if (rw == IOREAD) {
+    memcpy(buf, data, BYTESPERBLOCK);
+  } else {
+    memcpy(data, buf, BYTESPERBLOCK);
+    if (!s_cacheDirty[s]) { s_cacheDirty[s] = 1; ++g_cacheDirty; }
+  }
+
+  pthread_mutex_unlock(&g_bioLock);
+
+  statsCache(hit);
+  HOOK(hit ? HKCACHEHIT : HKCACHEMISS, dbn, rw);
+  PROFLEAVE();
+}
+
+
+
+// ============================================================================
+// Write back every dirty cache slot.  Called with g_bioLock held
+// ============================================================================
+static void bioCacheFlush() {
+  for (i32 s = 0; s < g_cacheUsed; ++s) {
+    if (!s_cacheDirty[s]) continue;
+    bioDevIO(s_cacheDbn[s], s_cacheData + s * BYTESPERBLOCK, IOWRITE);
+    s_cacheDirty[s] = 0;
+  }
+  g_cacheDirty = 0;
+}
+
+
+
+// ============================================================================
+// Return the size of the block cache, in blocks; 0 if there is none
+// ============================================================================
+i32 bioCache() {
+  pthread_mutex_lock(&g_bioLock);
+  i32 n = g_cacheSize;
+  pthread_mutex_unlock(&g_bioLock);
+  return n;
+}
+
+
+
+// ============================================================================
+// Return 1 if block 'dbn' is in the block cache now, otherwise 0
+// ============================================================================
+i32 bioCached(i32 dbn) {
+  if (dbn < 0 || dbn >= BLOCKSPERDISK) return 0;
+  pthread_mutex_lock(&g_bioLock);
+  i32 hit = (g_cacheSize > 0 && s_cacheSlot[dbn] >= 0);
+  pthread_mutex_unlock(&g_bioLock);
+  return hit;
+}
+
+
+
+// ============================================================================
+// Write back everything bio holds, then release the backend and empty the
+// block cache.  The next bio call reopens the disk image.  Call this before
+// anything outside bio rewrites the image, and before exit.  No other thread
+// may be inside bio meanwhile
+// ============================================================================
+i32 bioClose() {
+  bioSync();
+
+  pthread_mutex_lock(&g_bioLock);
+  devClose();
+  atomic_store(&g_bioReady, 0);
+
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) s_cacheSlot[dbn] = -1;
+  g_cacheUsed = 0;
+  g_cacheHead = g_cacheTail = -1;
+  pthread_mutex_unlock(&g_bioLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the number of blocks in the cache not yet written back
+// ============================================================================
+i32 bioDirty() {
+  pthread_mutex_lock(&g_bioLock);
+  i32 n = g_cacheDirty;
+  pthread_mutex_unlock(&g_bioLock);
+  return n;
+}
+
+
+
+// ============================================================================
+// Return the path of the BFS disk image that bio reads and writes
+// ============================================================================
+str bioDisk() { return g_bioDisk; }
+
+
+
+// ============================================================================
+// Start the disk cold, as after a restart: close bio, which empties the block
+// cache, and have the host drop the image from its page cache too
+// ============================================================================
+i32 bioEvict() {
+  bioClose();
+  if (devEvict(g_bioDisk) != 0) FATAL(ENODISK);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read block 'dbn' into 'buf' as bioRead would, from the block cache if it
+// holds it, but leave no trace: the cache order, the counters, traces and
+// tracepoints are all untouched.  For planners that must look without
+// disturbing what they look at
+// ============================================================================
+i32 bioPeek(i32 dbn, void* buf) {
+  if (dbn < 0)              FATAL(EBADDBN);
+  if (dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bioReady();
+  pthread_mutex_lock(&g_bioLock);
+  i32 s   = (g_cacheSize > 0) ? s_cacheSlot[dbn] : -1;
+  i32 ret = 0;
+  if (s >= 0) {
+    memcpy(buf, s_cacheData + s * BYTESPERBLOCK, BYTESPERBLOCK);
+  } else {
+    ret = devIO((i64)dbn * BYTESPERBLOCK, buf, BYTESPERBLOCK, IOREAD);
+  }
+  pthread_mutex_unlock(&g_bioLock);
+
+  if (ret == DEVNODISK) FATAL(ENODISK);
+  if (ret != 0)         FATAL(EBADREAD);
+  return 0;
+}
+
+
 
 // ============================================================================
 // Read 512 bytes from block number 'dbn' in the BFS disk into buffer 'buf'
 // ============================================================================
 i32 bioRead(i32 dbn, void* buf) {
 
-  if (dbn < 0)             FATAL(EBADDBN);
-  if (dbn > BLOCKSPERDISK) FATAL(EBADDBN);
+  if (dbn < 0)              FATAL(EBADDBN);
+  if (dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  HOOK(HKBIOREAD, dbn, 0);
+  PROFENTER(PROFBIO, PROFSAME);
+  i32 depth = blkIssue();
+  u64 t0    = histNow();
+  bioReady();
+
+  if (g_cacheSize > 0) bioCacheIO(dbn, buf, IOREAD);
+  else                 bioDevIO  (dbn, buf, IOREAD);
+
+  u64 lat = histNow() - t0;
+  i32 bc  = statsBio(dbn, IOREAD, lat);
+  blkEvent(dbn, IOREAD, statsOp(), bc, t0, lat, depth);
+  HOOK(HKBIOREADEND, dbn, lat);
+  PROFLEAVE();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Reach the disk image through backend 'backend', one of the BIOxxx.  If this
+// host cannot run it, stay with BIOSTDIO and return ENOBACKEND.  Otherwise
+// return 0
+// ============================================================================
+i32 bioSetBackend(i32 backend) {
+  if (backend < 0 || backend >= NUMBIO) return ENOBACKEND;
+  bioClose();
+
+  pthread_mutex_lock(&g_bioLock);
+  g_bioBackend = backend;
+  i32 ret = bioOpen();
+  if (ret == ENOBACKEND) g_bioBackend = BIOSTDIO;
+  pthread_mutex_unlock(&g_bioLock);
+
+  return (ret == ENOBACKEND) ? ENOBACKEND : 0;
+}
+
 
-  FILE* fp = fopen(BFSDISK, "rb+");
-  if (fp == NULL) FATAL(ENODISK);
 
-  i32 boff = dbn * BYTESPERBLOCK;
-  i32 ret  = fseek(fp, boff, SEEK_SET);
-  if (ret != 0) { fclose(fp); FATAL(ret); }
+// ============================================================================
+// Put a write-back block cache of 'blocks' blocks in front of the backend.
+// 0 removes it.  Whatever the old cache held is written back first
+// ============================================================================
+i32 bioSetCache(i32 blocks) {
+  if (blocks < 0) blocks = 0;
+  bioClose();
+
+  pthread_mutex_lock(&g_bioLock);
+  free(s_cacheData);
+  free(s_cacheDbn);
+  free(s_cachePrev);
+  free(s_cacheNext);
+  free(s_cacheDirty);
+  s_cacheData  = NULL;
+  s_cacheDbn   = s_cachePrev = s_cacheNext = NULL;
+  s_cacheDirty = NULL;
+  g_cacheSize  = 0;
 
-  i32 numb = fread(buf, 1, BYTESPERBLOCK, fp);
-  if (numb != BYTESPERBLOCK) { fclose(fp); FATAL(EBADREAD); }
+  if (blocks > 0) {
+    s_cacheData  = malloc((size_t)blocks * BYTESPERBLOCK);
+    s_cacheDbn   = malloc(blocks * sizeof(i32));
+    s_cachePrev  = malloc(blocks * sizeof(i32));
+    s_cacheNext  = malloc(blocks * sizeof(i32));
+    s_cacheDirty = calloc(blocks, 1);
+    if (s_cacheData == NULL || s_cacheDbn == NULL || s_cachePrev == NULL ||
+        s_cacheNext == NULL || s_cacheDirty == NULL) FATAL(ENOMEM);
+    g_cacheSize = blocks;
+  }
+  pthread_mutex_unlock(&g_bioLock);
+  return 0;
+}
 
-  fclose(fp);
+
+
+// ============================================================================
+// Direct all further block IO to the disk image at 'path', instead of the
+// default BFSDISK
+// ============================================================================
+i32 bioSetDisk(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+  bioClose();
+  g_bioDisk = path;
   return 0;
 }
 
 
+
+// ============================================================================
+// Hand everything bio holds to the kernel: dirty cache blocks, and the image
+// itself for BIORAM.  Like the backends, this does not fsync
+// ============================================================================
+i32 bioSync() {
+  pthread_mutex_lock(&g_bioLock);
+  bioCacheFlush();
+  if (devSync() != 0) FATAL(EBADWRITE);
+  pthread_mutex_unlock(&g_bioLock);
+  return 0;
+}
+
+
+
 // ============================================================================
 // Write 512 bytes from 'buf' into block number 'dbn' of the BFS disk
 // ============================================================================
 i32 bioWrite(i32 dbn, void* buf) {
 
-  FILE* fp = fopen(BFSDISK, "rb+");
-  if (fp == NULL) FATAL(ENODISK);
+  if (dbn < 0)              FATAL(EBADDBN);
+  if (dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
 
-  i32 boff = dbn * BYTESPERBLOCK;
-  i32 ret  = fseek(fp, boff, SEEK_SET);
-  if (ret != 0) { fclose(fp); FATAL(ret); }
+  HOOK(HKBIOWRITE, dbn, 0);
+  PROFENTER(PROFBIO, PROFSAME);
+  i32 depth = blkIssue();
+  u64 t0    = histNow();
+  bioReady();
 
-  i32 numb = fwrite(buf, 1, BYTESPERBLOCK, fp);
-  if (numb != BYTESPERBLOCK) { fclose(fp); FATAL(EBADWRITE); }
+  if (g_cacheSize > 0) bioCacheIO(dbn, buf, IOWRITE);
+  else                 bioDevIO  (dbn, buf, IOWRITE);
 
-  fclose(fp);
+  u64 lat = histNow() - t0;
+  i32 bc  = statsBio(dbn, IOWRITE, lat);
+  blkEvent(dbn, IOWRITE, statsOp(), bc, t0, lat, depth);
+  HOOK(HKBIOWRITEEND, dbn, lat);
+  PROFLEAVE();
 
   return 0;
 }
@@ -3,14 +3,38 @@
 
 // ===================================================================
 // bio.h - Block IO interface.  Simulates kernel-mode read and write
-// functions to the BFS disk
+// functions to the BFS disk.
+//
+// The disk image is reached through one of several backends, chosen
+// with bioSetBackend.  An optional write-back block cache, sized with
+// bioSetCache, sits in front of whichever backend is chosen
 // ===================================================================
 
 #include <stdio.h>
 
 #include "alias.h"
 
-i32 bioRead (i32 dbn, void* buf);
-i32 bioWrite(i32 dbn, void* buf);
+#define BIOSTDIO      0           // Backends: fopen/fseek/fread per call
+#define BIOPREAD      1           //   pread/pwrite on a file kept open
+#define BIOMMAP       2           //   memcpy to/from a shared mapping
+#define BIODIRECT     3           //   pread/pwrite with O_DIRECT
+#define BIOAIO        4           //   POSIX aio, waited on at once
+#define BIORAM        5           //   image held in memory until bioSync
+#define NUMBIO        6
 
-#endif
\ No newline at end of file
+str bioBackendName(i32 backend);
+i32 bioCache      ();
+i32 bioCached     (i32 dbn);
+i32 bioClose      ();
+i32 bioDirty      ();
+str bioDisk       ();
+i32 bioEvict      ();
+i32 bioPeek       (i32 dbn, void* buf);
+i32 bioRead       (i32 dbn, void* buf);
+i32 bioSetBackend (i32 backend);
+i32 bioSetCache   (i32 blocks);
+i32 bioSetDisk    (str path);
+i32 bioSync       ();
+i32 bioWrite      (i32 dbn, void* buf);
+
+#endif
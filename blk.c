@@ -0,0 +1,347 @@
+// ============================================================================
+// blk.c - blktrace-style event tracing at the bio layer
+// ============================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "blk.h"
+#include "hist.h"
+#include "stats.h"
+
+typedef struct BlkRing {            // one per tracing thread
+  BlkEvent ev[BLKRINGSIZE];
+  _Atomic u32 head;                 // next slot to fill; owner thread only
+  _Atomic u32 tail;                 // next slot to drain; drainer only
+  struct BlkRing* next;             // next on g_blkRings
+} BlkRing;
+
+static atomic_int      g_blkOn       = 0;      // tracing enabled?
+static atomic_int      g_blkInFlight = 0;      // bio calls in progress
+static atomic_ulong    g_blkDropped  = 0;      // events lost to full rings
+static u64             g_blkT0       = 0;      // histNow() at blkTraceStart
+static FILE*           g_blkFp       = NULL;   // trace file
+static BlkRing*        g_blkRings    = NULL;   // every thread's ring
+static pthread_mutex_t g_blkLock     = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local BlkRing* t_blkRing = NULL;
+
+
+
+// ============================================================================
+// Return this thread's ring, creating and registering it on first use
+// ============================================================================
+static BlkRing* blkRing() {
+  if (t_blkRing != NULL) return t_blkRing;
+
+  BlkRing* r = calloc(1, sizeof(BlkRing));
+  if (r == NULL) FATAL(ENOMEM);
+
+  pthread_mutex_lock(&g_blkLock);
+  r->next = g_blkRings;
+  g_blkRings = r;
+  pthread_mutex_unlock(&g_blkLock);
+
+  t_blkRing = r;
+  return r;
+}
+
+
+
+// ============================================================================
+// Write every event waiting in ring 'r' to the trace file.  Caller holds
+// g_blkLock
+// ============================================================================
+static void blkDrainRing(BlkRing* r) {
+  u32 tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  u32 head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+  while (tail != head) {
+    u32 from = tail % BLKRINGSIZE;
+    u32 n    = head - tail;
+    if (from + n > BLKRINGSIZE) n = BLKRINGSIZE - from;  // up to ring end
+    if (g_blkFp != NULL) fwrite(&r->ev[from], sizeof(BlkEvent), n, g_blkFp);
+    tail += n;
+  }
+
+  atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+
+
+// ============================================================================
+// Sort the 'num' events 'ev' by issue time, keeping events issued at the same
+// time in the order given (a bottom-up merge sort)
+// ============================================================================
+static void blkSort(BlkEvent* ev, i64 num) {
+  BlkEvent* tmp = malloc((num > 0 ? num : 1) * sizeof(BlkEvent));
+  if (tmp == NULL) FATAL(ENOMEM);
+
+  for (i64 width = 1; width < num; width *= 2) {
+    for (i64 lo = 0; lo < num; lo += 2 * width) {
+      i64 mid = (lo + width     < num) ? lo + width     : num;
+      i64 hi  = (lo + 2 * width < num) ? lo + 2 * width : num;
+      i64 a = lo, b = mid, t = lo;
+      while (a < mid && b < hi) {
+        tmp[t++] = (ev[b].ns < ev[a].ns) ? ev[b++] : ev[a++];
+      }
+      while (a < mid) tmp[t++] = ev[a++];
+      while (b < hi)  tmp[t++] = ev[b++];
+    }
+    memcpy(ev, tmp, num * sizeof(BlkEvent));
+  }
+  free(tmp);
+}
+
+
+
+// ============================================================================
+// Read every event in trace file 'path' into a malloc'd array, which the
+// caller frees, and put their number in 'num'.  Each thread's ring reaches
+// the file whole, one ring after another, so the events are sorted back
+// into the order they were issued in
+// ============================================================================
+BlkEvent* blkLoad(str path, i64* num) {
+  if (path == NULL || num == NULL) FATAL(ENULLPTR);
+
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) FATAL(ENODISK);
+
+  BlkHeader hdr;
+  if (fread(&hdr, sizeof(BlkHeader), 1, fp) != 1 ||
+      hdr.magic != BLKMAGIC || hdr.version != BLKVERSION) {
+    fclose(fp);
+    FATAL(EBADREAD);
+  }
+
+  i64 cap = 4096;
+  BlkEvent* ev = malloc(cap * sizeof(BlkEvent));
+  if (ev == NULL) FATAL(ENOMEM);
+
+  *num = 0;
+  for (;;) {
+    if (*num == cap) {
+      cap *= 2;
+      ev = realloc(ev, cap * sizeof(BlkEvent));
+      if (ev == NULL) FATAL(ENOMEM);
+    }
+    if (fread(&ev[*num], sizeof(BlkEvent), 1, fp) != 1) break;
+    ++*num;
+  }
+  fclose(fp);
+
+  blkSort(ev, *num);
+  return ev;
+}
+
+
+
+// ============================================================================
+// Profile the events in trace file 'path', in the order they were issued,
+// into 'p'
+// ============================================================================
+i32 blkProfile(str path, BlkProfile* p) {
+  if (p == NULL) FATAL(ENULLPTR);
+  memset(p, 0, sizeof(BlkProfile));
+
+  i64       num;
+  BlkEvent* ev   = blkLoad(path, &num);
+  i32       prev = -1;
+
+  for (i64 e = 0; e < num; ++e) {
+    ++p->num;
+    if (ev[e].rw == IOREAD) ++p->reads;
+    p->lat += ev[e].lat;
+    if (ev[e].op < NUMOPS) ++p->ops[ev[e].op];
+    if (ev[e].bc < NUMBC)  ++p->classes[ev[e].bc];
+    ++p->depthBins[ev[e].depth >= 8 ? 8 : ev[e].depth];
+
+    i32 dbn = ev[e].dbn;
+    if (prev >= 0) {
+      i32 d = dbn - (prev + 1);         // 0 => sequential
+      if (d == 0)          ++p->seq;
+      if (dbn == prev)     ++p->same;
+      else if (dbn > prev) ++p->fwd;
+      else                 ++p->back;
+
+      u32 ad = (d < 0) ? -d : d;
+      p->dist += ad;
+      i32 bin = 0;
+      while (ad > 0 && bin < 16) { ad >>= 1; ++bin; }
+      ++p->seekBins[bin];
+    }
+    prev = dbn;
+  }
+
+  free(ev);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read the events in trace file 'path' and report how the bio calls were
+// spread over the disk: sequentiality, seek distances (in blocks, from the
+// block after the previous one), queue depths, and per-op/per-class counts
+// ============================================================================
+i32 blkAnalyze(str path) {
+  BlkProfile p;
+  blkProfile(path, &p);
+
+  printf("\n%s: %llu events (%llu reads, %llu writes)", path,
+    (unsigned long long)p.num, (unsigned long long)p.reads,
+    (unsigned long long)(p.num - p.reads));
+  if (p.num == 0) { printf("\n"); return 0; }
+
+  u64 moves = p.num - 1;
+  printf(", mean latency %.1f us \n", p.lat / 1e3 / p.num);
+  if (moves > 0) {
+    printf("sequential %5.1f%%   same block %5.1f%%   forward %5.1f%%   "
+      "backward %5.1f%%   mean seek %.1f blocks \n",
+      100.0 * p.seq  / moves, 100.0 * p.same / moves,
+      100.0 * p.fwd  / moves, 100.0 * p.back / moves,
+      (double)p.dist / moves);
+  }
+
+  printf("\nseek distance (blocks)   count \n");
+  for (i32 b = 0; b < BLKSEEKBINS; ++b) {
+    if (p.seekBins[b] == 0) continue;
+    if (b == 0) printf("  %-20s %7llu \n", "0 (sequential)",
+                  (unsigned long long)p.seekBins[b]);
+    else        printf("  %7u - %-10u %7llu \n", 1u << (b - 1),
+                  (1u << b) - 1, (unsigned long long)p.seekBins[b]);
+  }
+
+  printf("\nqueue depth   count \n");
+  for (i32 d = 1; d < BLKDEPTHBINS; ++d) {
+    if (p.depthBins[d] == 0) continue;
+    printf("  %2d%s       %7llu \n", d, d == 8 ? "+" : " ",
+      (unsigned long long)p.depthBins[d]);
+  }
+
+  printf("\nby op:    ");
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    if (p.ops[op] > 0) printf(" %s=%llu", statsOpName(op),
+                         (unsigned long long)p.ops[op]);
+  }
+  printf("\nby class: ");
+  for (i32 bc = 0; bc < NUMBC; ++bc) {
+    if (p.classes[bc] > 0) printf(" %s=%llu", statsClassName(bc),
+                             (unsigned long long)p.classes[bc]);
+  }
+  printf("\n\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Record a bio call on 'dbn', issued at histNow() time 't0' and taking 'lat'
+// nanoseconds.  'depth' is the value blkIssue returned for this call.  Never
+// blocks: if this thread's ring is full the event is dropped and counted
+// ============================================================================
+i32 blkEvent(i32 dbn, i32 rw, i32 op, i32 bc, u64 t0, u64 lat, i32 depth) {
+  if (depth > 0) atomic_fetch_sub_explicit(&g_blkInFlight, 1,
+                   memory_order_relaxed);
+  if (!atomic_load_explicit(&g_blkOn, memory_order_relaxed)) return 0;
+
+  BlkRing* r = blkRing();
+  u32 head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  u32 tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+  if (head - tail >= BLKRINGSIZE) {
+    atomic_fetch_add_explicit(&g_blkDropped, 1, memory_order_relaxed);
+    return 0;
+  }
+
+  BlkEvent* ev = &r->ev[head % BLKRINGSIZE];
+  ev->ns    = (t0 > g_blkT0) ? t0 - g_blkT0 : 0;
+  ev->dbn   = dbn;
+  ev->lat   = (lat > 0xFFFFFFFFULL) ? 0xFFFFFFFFU : (u32)lat;
+  ev->size  = BYTESPERBLOCK;
+  ev->rw    = (u8)rw;
+  ev->op    = (u8)op;
+  ev->bc    = (u8)bc;
+  ev->depth = (u8)(depth > 255 ? 255 : depth);
+  ev->pad   = 0;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+  // Past half full: drain now, unless another thread is already draining
+
+  if (head + 1 - tail > BLKRINGSIZE / 2 &&
+      pthread_mutex_trylock(&g_blkLock) == 0) {
+    blkDrainRing(r);
+    pthread_mutex_unlock(&g_blkLock);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Note that a bio call is starting.  Return the number of bio calls now in
+// flight, this one included, or 0 if tracing is off
+// ============================================================================
+i32 blkIssue() {
+  if (!atomic_load_explicit(&g_blkOn, memory_order_relaxed)) return 0;
+  return atomic_fetch_add_explicit(&g_blkInFlight, 1,
+           memory_order_relaxed) + 1;
+}
+
+
+
+// ============================================================================
+// Move the events waiting in every thread's ring into the trace file
+// ============================================================================
+i32 blkTraceDrain() {
+  pthread_mutex_lock(&g_blkLock);
+  for (BlkRing* r = g_blkRings; r != NULL; r = r->next) blkDrainRing(r);
+  if (g_blkFp != NULL) fflush(g_blkFp);
+  pthread_mutex_unlock(&g_blkLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Start tracing bio calls into a new trace file 'path'
+// ============================================================================
+i32 blkTraceStart(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) FATAL(EDISKCREATE);
+
+  BlkHeader hdr = { BLKMAGIC, BLKVERSION };
+  fwrite(&hdr, sizeof(BlkHeader), 1, fp);
+
+  pthread_mutex_lock(&g_blkLock);
+  for (BlkRing* r = g_blkRings; r != NULL; r = r->next) {
+    atomic_store(&r->tail, atomic_load(&r->head));      // discard stale
+  }
+  g_blkFp = fp;
+  g_blkT0 = histNow();
+  atomic_store(&g_blkDropped, 0);
+  atomic_store(&g_blkOn, 1);
+  pthread_mutex_unlock(&g_blkLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop tracing, drain what remains, and close the trace file.  Return the
+// number of events dropped because a ring was full
+// ============================================================================
+i32 blkTraceStop() {
+  atomic_store(&g_blkOn, 0);
+  blkTraceDrain();
+
+  pthread_mutex_lock(&g_blkLock);
+  if (g_blkFp != NULL) fclose(g_blkFp);
+  g_blkFp = NULL;
+  pthread_mutex_unlock(&g_blkLock);
+
+  return (i32)atomic_load(&g_blkDropped);
+}
@@ -0,0 +1,62 @@
+#ifndef BLK_H
+#define BLK_H
+
+// ===================================================================
+// blk.h - blktrace-style event tracing at the bio layer.  Each thread
+// appends one BlkEvent per bioRead/bioWrite into its own lock-free
+// ring; rings are drained into a trace file, one ring at a time, so
+// blkLoad sorts the events back into issue order.  blkAnalyze turns
+// them into seek-distance, sequentiality and queue-depth profiles
+// ===================================================================
+
+#include "alias.h"
+#include "stats.h"
+
+#define BLKMAGIC      0x4B4C4242  // "BBLK"
+#define BLKVERSION    1
+#define BLKRINGSIZE   4096        // events per thread ring; power of 2
+#define BLKSEEKBINS   17          // |seek| 0, 1, 2-3, 4-7, ...
+#define BLKDEPTHBINS  9           // queue depth 1..8; 8 => 8 or more
+
+typedef struct {          // BlkHeader
+  u32 magic;              // BLKMAGIC
+  u32 version;            // BLKVERSION
+} BlkHeader;
+
+typedef struct {          // BlkEvent
+  u64 ns;                 // issue time, nanoseconds since blkTraceStart
+  i32 dbn;                // block touched
+  u32 lat;                // latency, nanoseconds
+  u16 size;               // bytes transferred
+  u8  rw;                 // IOREAD or IOWRITE
+  u8  op;                 // originating fs.h operation (OPxxx)
+  u8  bc;                 // block class (BCxxx)
+  u8  depth;              // bio calls in flight, this one included
+  u16 pad;
+} BlkEvent;
+
+typedef struct {          // BlkProfile: see blkProfile
+  u64 num;                // events
+  u64 reads;              // ... of which, reads
+  u64 seq;                // moves to the block after the previous one
+  u64 same;               //   ... to the same block
+  u64 fwd;                //   ... forward, sequential included
+  u64 back;               //   ... backward
+  u64 dist;               // sum of |seek| in blocks
+  u64 lat;                // sum of latencies, ns
+  u64 seekBins[BLKSEEKBINS];
+  u64 depthBins[BLKDEPTHBINS];
+  u64 ops[NUMOPS];
+  u64 classes[NUMBC];
+} BlkProfile;
+
+i32 blkAnalyze   (str path);
+i32 blkEvent     (i32 dbn, i32 rw, i32 op, i32 bc, u64 t0, u64 lat, i32 depth);
+i32 blkIssue     ();
+BlkEvent* blkLoad(str path, i64* num);
+i32 blkProfile   (str path, BlkProfile* p);
+i32 blkTraceDrain();
+i32 blkTraceStart(str path);
+i32 blkTraceStop ();
+
+#endif
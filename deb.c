@@ -4,6 +4,8 @@
 
 #include "bfs.h"
 #include "deb.h"
+#include "fs.h"
+#include "stats.h"
 
 // ============================================================================
 // Dump block DBN
@@ -68,6 +70,132 @@ i32 debDumpDir() {
 
 
 
+// ============================================================================
+// Dump the per-file counters, busiest file first.  Names come from the Dir,
+// peeked at so as not to add to the counts; a file since deleted shows as
+// "-"
+// ============================================================================
+i32 debDumpFiles() {
+  FileStats top[NUMINODES];
+  i32 num = fsTopFiles(top, NUMINODES);
+  if (num == 0) return 0;
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioPeek(DBNDIR, buf);
+  Dir* dir = (Dir*)buf;
+
+  printf("\n%-4s %-15s %8s %8s %6s %10s %10s %8s %8s %6s %10s \n", "inum",
+    "file", "reads", "writes", "seeks", "bytes-rd", "bytes-wr", "bio-rd",
+    "bio-wr", "hit%", "ms");
+  for (i32 i = 0; i < num; ++i) {
+    FileStats* f = &top[i];
+    str name = dir->fname[f->inum][0] ? dir->fname[f->inum] : "-";
+    u64 look = f->hits + f->misses;
+    printf("%-4d %-15.15s %8llu %8llu %6llu %10llu %10llu %8llu %8llu %5.1f%% "
+      "%10.3f \n", f->inum, name,
+      (unsigned long long)f->ops[OPREAD], (unsigned long long)f->ops[OPWRITE],
+      (unsigned long long)f->ops[OPSEEK],
+      (unsigned long long)f->bytes[IOREAD],
+      (unsigned long long)f->bytes[IOWRITE],
+      (unsigned long long)f->bio[IOREAD], (unsigned long long)f->bio[IOWRITE],
+      look ? 100.0 * f->hits / look : 0.0, f->ns / 1e6);
+  }
+  printf("\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Walk the block map of file 'inum' and summarize its layout into 'lay'.  An
+// extent is a run of FBNs held in consecutive DBNs.  Seek distance is how far
+// each mapped block lies from the block after the previous mapped one
+// ============================================================================
+i32 debFileLayout(i32 inum, Layout* lay) {
+  if (lay == NULL) FATAL(ENULLPTR);
+  memset(lay, 0, sizeof(Layout));
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i16 ind[I16SPERBLOCK] = {0};
+  if (inode.indirect != 0) {
+    statsClass(BCINDIRECT);
+    bioRead(inode.indirect, ind);
+  }
+
+  i32 numFbns = (inode.size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+  i32 prev    = -1;                 // last mapped DBN
+  i32 inRun   = 0;                  // previous FBN extended an extent?
+
+  for (i32 fbn = 0; fbn < numFbns && fbn < MAXFBN; ++fbn) {
+    i32 dbn = (fbn < NUMDIRECT) ? inode.direct[fbn] : ind[fbn - NUMDIRECT];
+    if (dbn < MINDBN || dbn >= BLOCKSPERDISK) {
+      ++lay->holes;
+      inRun = 0;
+      continue;
+    }
+
+    ++lay->blocks;
+    if (prev >= 0) {
+      i32 d = dbn - (prev + 1);
+      lay->seek += (d < 0) ? -d : d;
+      if (d == 0) ++lay->seq;
+    }
+    if (!inRun || dbn != prev + 1) ++lay->extents;
+    prev  = dbn;
+    inRun = 1;
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Find the runs of consecutive free blocks.  Mark every block on the
+// Freelist, then count runs by length into 'bins': bins[b] counts runs of
+// 2^b to 2^(b+1)-1 blocks.  Also return, in 'inOrder', how many Freelist
+// links point at the very next DBN - the allocator hands blocks out in
+// Freelist order, so this predicts how contiguous new files will be.
+// Return the number of free blocks
+// ============================================================================
+i32 debFreeRuns(i32 bins[DEBRUNBINS], i32* inOrder) {
+  i8 isFree[BLOCKSPERDISK] = {0};
+  for (i32 b = 0; b < DEBRUNBINS; ++b) bins[b] = 0;
+  *inOrder = 0;
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf);
+  Super* super = (Super*)buf;
+
+  i32 num = 0;
+  i32 dbn = super->firstFree;
+  while (dbn >= MINDBN && dbn < BLOCKSPERDISK && !isFree[dbn]) {
+    i16 buf16[I16SPERBLOCK] = {0};
+    statsClass(BCFREE);
+    bioRead(dbn, buf16);
+    isFree[dbn] = 1;
+    ++num;
+    if (buf16[0] == dbn + 1) ++*inOrder;
+    dbn = buf16[0];
+  }
+
+  i32 run = 0;
+  for (i32 d = MINDBN; d <= BLOCKSPERDISK; ++d) {
+    if (d < BLOCKSPERDISK && isFree[d]) { ++run; continue; }
+    if (run > 0) {
+      i32 b = 0;
+      while ((run >> (b + 1)) > 0 && b < DEBRUNBINS - 1) ++b;
+      ++bins[b];
+    }
+    run = 0;
+  }
+  return num;
+}
+
+
+
 // ============================================================================
 // Dump the Inodes
 // ============================================================================
@@ -92,6 +220,212 @@ i32 debDumpInodes() {
 }
 
 
+// ============================================================================
+// Dump 'plan', filled by fsExplain: what the request would cost, then each
+// bio call it would make, in order
+// ============================================================================
+i32 debDumpPlan(FsPlan* plan) {
+  if (plan == NULL) FATAL(ENULLPTR);
+
+  printf("\n%s of %d bytes at %d: would move %d bytes; size %d -> %d \n",
+    statsOpName(plan->op), plan->len, plan->offset, plan->bytes, plan->size,
+    plan->newSize);
+  printf("%d bio calls: %d metadata, %d data; %d cache hits; %d blocks "
+    "allocated \n", plan->numSteps, plan->metaIOs, plan->dataIOs,
+    plan->hits, plan->allocs);
+  if (plan->full) printf("the disk would fill up: EDISKFULL \n");
+
+  printf("\n%5s %5s %-9s %-5s %s \n", "#", "dbn", "role", "rw", "cache");
+  for (i32 i = 0; i < plan->numSteps && i < FSPLANSTEPS; ++i) {
+    FsStep* s = &plan->steps[i];
+    printf("%5d %5d %-9s %-5s %s \n", i, s->dbn, statsClassName(s->bc),
+      s->rw == IOREAD ? "read" : "write", s->hit ? "hit" : "miss");
+  }
+  if (plan->numSteps > FSPLANSTEPS) {
+    printf("  ... and %d more \n", plan->numSteps - FSPLANSTEPS);
+  }
+  printf("\n"); fflush(stdout);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump the bio accounting.  For each fs.h operation that has been called,
+// print the reads/writes it issued on each class of block, averaged per
+// call, and the ratio of metadata I/Os to data I/Os
+// ============================================================================
+i32 debDumpIO() {
+  IOStats st;
+  statsGet(&st);
+
+  printf("\n%-7s %8s", "op", "calls");
+  for (i32 bc = 0; bc < NUMBC; ++bc) printf(" %11s", statsClassName(bc));
+  printf(" %9s \n", "meta/data");
+
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    u64 meta = 0;
+    u64 data = 0;
+    u64 any  = 0;
+    for (i32 bc = 0; bc < NUMBC; ++bc) {
+      u64 n = st.io[op][bc][IOREAD] + st.io[op][bc][IOWRITE];
+      if (bc == BCDATA) data += n; else meta += n;
+      any += n;
+    }
+    if (st.calls[op] == 0 && any == 0) continue;
+
+    u64 calls = (st.calls[op] == 0) ? 1 : st.calls[op];
+    printf("%-7s %8llu", statsOpName(op), (unsigned long long)st.calls[op]);
+    for (i32 bc = 0; bc < NUMBC; ++bc) {
+      printf(" %5.1fr/%4.1fw",
+        (double)st.io[op][bc][IOREAD]  / calls,
+        (double)st.io[op][bc][IOWRITE] / calls);
+    }
+    if (data == 0) printf(" %9s \n", "-");
+    else           printf(" %9.2f \n", (double)meta / data);
+  }
+  printf("\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump the latency histograms, as percentiles in microseconds, for every
+// fs.h operation and bio call that has been timed
+// ============================================================================
+i32 debDumpLatency() {
+  Hist h;
+
+  printf("\n%-8s %8s %9s %9s %9s %9s %9s %9s %9s \n", "op", "count",
+    "min", "p50", "p90", "p99", "p99.9", "max", "mean");
+
+  for (i32 lat = 0; lat < NUMLAT; ++lat) {
+    statsGetHist(lat, &h);
+    if (h.count == 0) continue;
+    printf("%-8s %8llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f \n",
+      statsLatName(lat), (unsigned long long)h.count,
+      h.min / 1e3,
+      histPercentile(&h, 50.0) / 1e3,
+      histPercentile(&h, 90.0) / 1e3,
+      histPercentile(&h, 99.0) / 1e3,
+      histPercentile(&h, 99.9) / 1e3,
+      h.max / 1e3,
+      (double)h.sum / h.count / 1e3);
+  }
+  printf("(microseconds) \n\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump the layout of every file in the Directory, then how fragmented the
+// free space is.  Contiguity is the share of blocks that directly follow the
+// previous block of the file; holes are unmapped FBNs below EOF
+// ============================================================================
+i32 debDumpLayout() {
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioRead(DBNDIR, buf);
+  Dir* dir = (Dir*)buf;
+
+  Layout tot;
+  memset(&tot, 0, sizeof(Layout));
+  i32 files = 0;
+
+  printf("\n%-4s %-16s %8s %6s %7s %6s %9s %5s \n", "inum", "name", "size",
+    "blocks", "extents", "contig", "mean-seek", "holes");
+
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    if (dir->fname[inum][0] == '\0') continue;
+
+    Layout lay;
+    debFileLayout(inum, &lay);
+
+    Inode inode;
+    bfsReadInode(inum, &inode);
+
+    printf("[%02d] %-16s %8d %6d %7d %5.0f%% %9.1f %5d \n", inum,
+      dir->fname[inum], inode.size, lay.blocks, lay.extents,
+      lay.blocks > 1 ? 100.0 * lay.seq / (lay.blocks - 1) : 100.0,
+      lay.blocks > 1 ? (double)lay.seek / (lay.blocks - 1) : 0.0,
+      lay.holes);
+
+    ++files;
+    tot.blocks  += lay.blocks;
+    tot.extents += lay.extents;
+    tot.holes   += lay.holes;
+    tot.seq     += lay.seq;
+    tot.seek    += lay.seek;
+  }
+
+  if (files > 0) {
+    printf("%d files, %d blocks, %.2f extents/file, mean run %.2f blocks, "
+      "%d holes \n", files, tot.blocks, (double)tot.extents / files,
+      tot.extents > 0 ? (double)tot.blocks / tot.extents : 0.0, tot.holes);
+  }
+
+  i32 bins[DEBRUNBINS];
+  i32 inOrder = 0;
+  i32 numFree = debFreeRuns(bins, &inOrder);
+
+  printf("\n%d free blocks; %d of %d Freelist links in DBN order \n",
+    numFree, inOrder, numFree > 0 ? numFree - 1 : 0);
+  printf("free run (blocks)   runs \n");
+  for (i32 b = 0; b < DEBRUNBINS; ++b) {
+    if (bins[b] == 0) continue;
+    printf("  %5d - %-7d %6d \n", 1 << b, (1 << (b + 1)) - 1, bins[b]);
+  }
+  printf("\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump the fsGetStats snapshot: what the volume has done since counting
+// started, and what it holds open now
+// ============================================================================
+i32 debDumpStats() {
+  FsStats st;
+  fsGetStats(&st);
+
+  double secs = st.elapsedNs / 1e9;
+  printf("\nelapsed   %10.3f s \n", secs);
+  printf("ops      ");
+  for (i32 op = 1; op < NUMOPS; ++op) {
+    if (st.ops[op] == 0) continue;
+    printf(" %s=%llu", statsOpName(op), (unsigned long long)st.ops[op]);
+  }
+  printf(" \n");
+  printf("bytes     %10llu read, %10llu written \n",
+    (unsigned long long)st.bytesRead, (unsigned long long)st.bytesWritten);
+  printf("bio       %10llu read, %10llu written, %.1f%% metadata \n",
+    (unsigned long long)st.bioReads, (unsigned long long)st.bioWrites,
+    st.bioReads + st.bioWrites == 0 ? 0.0
+      : 100.0 * st.metaIOs / (st.bioReads + st.bioWrites));
+  printf("device    %10llu read, %10llu written \n",
+    (unsigned long long)st.devReads, (unsigned long long)st.devWrites);
+  if (st.cacheHits + st.cacheMisses > 0) {
+    printf("cache     %10llu hits, %10llu misses, %.1f%% hit, %d dirty \n",
+      (unsigned long long)st.cacheHits, (unsigned long long)st.cacheMisses,
+      100.0 * st.cacheHits / (st.cacheHits + st.cacheMisses), st.dirty);
+  }
+  printf("allocs    %10llu (%.0f/s), %llu frees \n",
+    (unsigned long long)st.allocs, st.allocsPerSec,
+    (unsigned long long)st.frees);
+  printf("errors    %10llu \n", (unsigned long long)st.errors);
+  printf("OFT       %10d of %d entries in use \n\n", st.oftUsed, st.oftSize);
+  fflush(stdout);
+
+  return 0;
+}
+
+
+
 // ============================================================================
 // Dump the Superblock
 // ============================================================================
@@ -8,10 +8,29 @@
 #include <ctype.h>
 #include <stdio.h>
 #include "alias.h"
+#include "fs.h"
+
+#define DEBRUNBINS    16  // free-run histogram: 1, 2-3, 4-7, ... blocks
+
+typedef struct {          // Layout of one file
+  i32 blocks;             // # data blocks mapped
+  i32 extents;            // # runs of consecutive DBNs
+  i32 holes;              // # FBNs below EOF with no DBN
+  i32 seq;                // # blocks that directly follow the previous one
+  i64 seek;               // sum of distances between successive blocks
+} Layout;
 
 i32 debDumpDbn   (i32 dbn, i32 size);
 i32 debDumpDir   ();
+i32 debDumpFiles ();
 i32 debDumpInodes();
+i32 debDumpIO    ();
+i32 debDumpLayout();
+i32 debDumpLatency();
+i32 debDumpPlan  (FsPlan* plan);
+i32 debDumpStats ();
 i32 debDumpSuper ();
+i32 debFileLayout(i32 inum, Layout* lay);
+i32 debFreeRuns  (i32 bins[DEBRUNBINS], i32* inOrder);
 
 #endif
\ No newline at end of file
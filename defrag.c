@@ -0,0 +1,481 @@
+// ============================================================================
+// defrag.c - offline and online defragmenter for a BFS disk
+// ============================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "defrag.h"
+#include "fs.h"
+#include "fsck.h"
+#include "hist.h"
+#include "hook.h"
+#include "stats.h"
+
+#define DEFRAGMAXFBNS (NUMDIRECT + I16SPERBLOCK)
+#define DEFRAGSLICEMS 10          // how often the idle thread checks for stop
+
+static i8 s_defragOld[BLOCKSPERDISK][BYTESPERBLOCK];  // image, as found
+static i8 s_defragNew[BLOCKSPERDISK][BYTESPERBLOCK];  //   ... and compacted
+
+static atomic_int   g_defragStop = 0;       // online pass finishes when set
+static i32          g_defragRun  = 0;       // thread running?
+static i32          g_defragRate = 0;       // its blocks per second
+static DefragReport g_defragRep;            // its report, over all passes
+static pthread_t    g_defragTid;
+
+
+
+// ============================================================================
+// Fill 'dbns' with the DBN of each FBN below EOF of the file with Inode 'ino'
+// and indirect block 'ind' (NULL if none); 0 for a hole.  Return the number
+// of FBNs
+// ============================================================================
+static i32 defragFbns(Inode* ino, i16* ind, i16* dbns) {
+  i32 numFbns = (ino->size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+  if (numFbns < 0)             numFbns = 0;
+  if (numFbns > DEFRAGMAXFBNS) numFbns = DEFRAGMAXFBNS;
+
+  for (i32 fbn = 0; fbn < numFbns; ++fbn) {
+    i32 dbn = 0;
+    if (fbn < NUMDIRECT)  dbn = ino->direct[fbn];
+    else if (ind != NULL) dbn = ind[fbn - NUMDIRECT];
+    dbns[fbn] = (dbn >= MINDBN && dbn < BLOCKSPERDISK) ? dbn : 0;
+  }
+  return numFbns;
+}
+
+
+
+// ============================================================================
+// Return the number of extents - runs of consecutive DBNs - in the 'num'
+// FBNs mapped by 'dbns'.  A hole ends a run, as in debFileLayout
+// ============================================================================
+static i32 defragExtents(i16* dbns, i32 num) {
+  i32 extents = 0;
+  i32 prev    = -1;
+  for (i32 fbn = 0; fbn < num; ++fbn) {
+    if (dbns[fbn] == 0) {
+      prev = -1;
+      continue;
+    }
+    if (prev < 0 || dbns[fbn] != prev + 1) ++extents;
+    prev = dbns[fbn];
+  }
+  return extents;
+}
+
+
+
+// ============================================================================
+// Defragment the BFS disk in use, which nothing may be using meanwhile.  Pack
+// every file, in inum order, from MINDBN up: its indirect block, if it still
+// maps anything, then its data blocks in FBN order.  Map entries past EOF are
+// dropped.  The free blocks that remain form one run, linked in DBN order.
+// The image is built in memory and replaces the old one whole, by rename.
+// Fill 'rep'.  Return 0, or EBADDISK, leaving the disk alone, if fsck finds
+// errors
+// ============================================================================
+i32 defragOffline(DefragReport* rep) {
+  if (rep == NULL) FATAL(ENULLPTR);
+  memset(rep, 0, sizeof(DefragReport));
+  u64 t0 = histNow();
+
+  FsckReport check;
+  if (fsckRun(0, &check) != 0) return EBADDISK;
+
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) {
+    bioPeek(dbn, s_defragOld[dbn]);
+  }
+  memset(s_defragNew, 0, sizeof(s_defragNew));
+  memcpy(s_defragNew, s_defragOld, NUMMETA * BYTESPERBLOCK);
+
+  Dir*   dir    = (Dir*)s_defragNew[DBNDIR];
+  Inode* inodes = (Inode*)s_defragNew[DBNINODES];
+  i32    next   = MINDBN;                   // next DBN to fill
+  i16    dbns[DEFRAGMAXFBNS];
+
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    Inode* ino = &inodes[inum];
+    i16*   ind = ino->indirect ? (i16*)s_defragOld[ino->indirect] : NULL;
+    i32    num = defragFbns(ino, ind, dbns);
+    if (dir->fname[inum][0] != 0) ++rep->files;
+    rep->extentsBefore += defragExtents(dbns, num);
+
+    i32 oldIndirect = ino->indirect;
+    i32 moved       = 0;
+    memset(ino->direct, 0, sizeof(ino->direct));
+    ino->indirect = 0;
+    for (i32 fbn = NUMDIRECT; fbn < num; ++fbn) {
+      if (dbns[fbn] == 0) continue;
+      ino->indirect = next++;
+      moved += (ino->indirect != oldIndirect);
+      break;
+    }
+
+    for (i32 fbn = 0; fbn < num; ++fbn) {
+      if (dbns[fbn] == 0) continue;               // a hole stays one
+      i32 dbn = next++;
+      memcpy(s_defragNew[dbn], s_defragOld[dbns[fbn]], BYTESPERBLOCK);
+      if (fbn < NUMDIRECT) {
+        ino->direct[fbn] = dbn;
+      } else {
+        ((i16*)s_defragNew[ino->indirect])[fbn - NUMDIRECT] = dbn;
+      }
+      moved    += (dbn != dbns[fbn]);
+      dbns[fbn] = dbn;
+    }
+
+    rep->extentsAfter += defragExtents(dbns, num);
+    rep->blocks       += moved;
+    if (moved > 0) ++rep->moved;
+  }
+
+  i16 link = 0;                                 // Freelist, back to front
+  for (i32 dbn = BLOCKSPERDISK - 1; dbn >= next; --dbn) {
+    ((i16*)s_defragNew[dbn])[0] = link;
+    link = dbn;
+  }
+  ((Super*)s_defragNew[DBNSUPER])->firstFree = link;
+
+  if (memcmp(s_defragNew, s_defragOld, sizeof(s_defragNew)) != 0) {
+    char tmp[FILENAME_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", bioDisk());
+    bioClose();
+    FILE* fp = fopen(tmp, "wb");
+    if (fp == NULL) FATAL(EDISKCREATE);
+    size_t n = fwrite(s_defragNew, BYTESPERBLOCK, BLOCKSPERDISK, fp);
+    if (fclose(fp) != 0 || n != BLOCKSPERDISK) FATAL(EBADWRITE);
+    if (rename(tmp, bioDisk()) != 0)           FATAL(EBADWRITE);
+  }
+
+  rep->ns = histNow() - t0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read the Inode of file 'inum' into 'ino', and its indirect block, if any,
+// into 'ind'; else zero 'ind'.  Hold fsLock
+// ============================================================================
+static void defragLoad(i32 inum, Inode* ino, i16* ind) {
+  bfsReadInode(inum, ino);
+  memset(ind, 0, BYTESPERBLOCK);
+  if (ino->indirect == 0) return;
+  statsClass(BCINDIRECT);
+  bioRead(ino->indirect, ind);
+}
+
+
+
+// ============================================================================
+// Add up the extents of every file into 'extents', and return the number of
+// files in the Directory.  Hold fsLock
+// ============================================================================
+static i32 defragScan(i32* extents) {
+  i8 buf[BYTESPERBLOCK];
+  bioRead(DBNDIR, buf);
+  Dir* dir = (Dir*)buf;
+
+  i32 files = 0;
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    if (dir->fname[inum][0] == 0) continue;
+    Inode ino;
+    i16   ind[I16SPERBLOCK];
+    i16   dbns[DEFRAGMAXFBNS];
+    defragLoad(inum, &ino, ind);
+    *extents += defragExtents(dbns, defragFbns(&ino, ind, dbns));
+    ++files;
+  }
+  return files;
+}
+
+
+
+// ============================================================================
+// Walk the Freelist, setting isFree[dbn] for each block on it.  A link out of
+// range, or a loop, ends the walk.  Hold fsLock
+// ============================================================================
+static void defragFreeMap(u8* isFree) {
+  memset(isFree, 0, BLOCKSPERDISK);
+  i8 buf8[BYTESPERBLOCK];
+  bioRead(DBNSUPER, buf8);
+
+  i32 dbn = ((Super*)buf8)->firstFree;
+  while (dbn >= MINDBN && dbn < BLOCKSPERDISK && !isFree[dbn]) {
+    isFree[dbn] = 1;
+    i16 link[I16SPERBLOCK];
+    statsClass(BCFREE);
+    bioRead(dbn, link);
+    dbn = link[0];
+  }
+}
+
+
+
+// ============================================================================
+// Rebuild the Freelist from 'isFree', linked in DBN order, so that blocks are
+// next handed out lowest first, in runs.  Hold fsLock
+// ============================================================================
+static void defragRelink(u8* isFree) {
+  i16 link = 0;                                 // back to front
+  for (i32 dbn = BLOCKSPERDISK - 1; dbn >= MINDBN; --dbn) {
+    if (!isFree[dbn]) continue;
+    i16 buf16[I16SPERBLOCK] = {0};
+    buf16[0] = link;
+    statsClass(BCFREE);
+    bioWrite(dbn, buf16);
+    link = dbn;
+  }
+
+  i8 buf8[BYTESPERBLOCK];
+  bioRead(DBNSUPER, buf8);
+  ((Super*)buf8)->firstFree = link;
+  bioWrite(DBNSUPER, buf8);
+}
+
+
+
+// ============================================================================
+// Find the lowest run of 'num' DBNs where each block j is free, or is src[j]
+// already.  Return its first DBN, or 0 if there is none
+// ============================================================================
+static i32 defragRun(u8* isFree, i32* src, i32 num) {
+  for (i32 at = MINDBN; at + num <= BLOCKSPERDISK; ++at) {
+    i32 j = 0;
+    while (j < num && (isFree[at + j] || src[j] == at + j)) ++j;
+    if (j == num) return at;
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Move FBN 'fbn' of file 'inum' (-1: its indirect block) from DBN 'src' to
+// reserved DBN 'dst': copy the block, switch the map entry to 'dst', then
+// free 'src'.  If the map no longer points at 'src' - the file was written or
+// deleted since it was looked at - do nothing.  Return 1 if moved, else 0.
+// Hold fsLock
+// ============================================================================
+static i32 defragMove(i32 inum, i32 fbn, i32 src, i32 dst) {
+  Inode ino;
+  i16   ind[I16SPERBLOCK];
+  defragLoad(inum, &ino, ind);
+
+  i32 cur;                                      // what the map holds now
+  if      (fbn < 0)         cur = ino.indirect;
+  else if (fbn < NUMDIRECT) cur = ino.direct[fbn];
+  else                      cur = ind[fbn - NUMDIRECT];
+  if (cur != src) return 0;
+
+  i8  buf[BYTESPERBLOCK];
+  i32 bc = (fbn < 0) ? BCINDIRECT : BCDATA;
+  statsClass(bc);
+  bioRead(src, buf);
+  statsClass(bc);
+  bioWrite(dst, buf);
+
+  if (fbn < NUMDIRECT) {
+    if (fbn < 0) ino.indirect = dst; else ino.direct[fbn] = dst;
+    bfsWriteInode(inum, &ino);
+  } else {
+    ind[fbn - NUMDIRECT] = dst;
+    statsClass(BCINDIRECT);
+    bioWrite(ino.indirect, ind);
+  }
+
+  bfsFreeBlock(src);
+  return 1;
+}
+
+
+
+// ============================================================================
+// Wait long enough that moves happen at no more than 'rate' per second
+// ============================================================================
+static void defragPace(i32 rate) {
+  if (rate <= 0) return;
+  histSleepNs(1000000000ULL / rate);
+}
+
+
+
+// ============================================================================
+// Make file 'inum' contiguous, if it is not: reserve the lowest free run that
+// holds its indirect block and data blocks, then move them there one by one,
+// at most 'rate' per second, taking fsLock for each move alone.  Return the
+// number of blocks moved, or -1 if no free run would fit
+// ============================================================================
+static i32 defragFile(i32 inum, i32 rate) {
+  Inode ino;
+  i16   ind[I16SPERBLOCK];
+  i16   dbns[DEFRAGMAXFBNS];
+  i32   src[DEFRAGMAXFBNS + 1];                 // the blocks, in the order
+  i32   fbn[DEFRAGMAXFBNS + 1];                 //   wanted: indirect first
+  u8    isFree[BLOCKSPERDISK];
+  i32   num = 0;
+
+  fsLock();
+  defragLoad(inum, &ino, ind);
+  i32 numFbns = defragFbns(&ino, ind, dbns);
+  if (ino.indirect >= MINDBN && ino.indirect < BLOCKSPERDISK) {
+    src[num]   = ino.indirect;
+    fbn[num++] = -1;
+  }
+  for (i32 f = 0; f < numFbns; ++f) {
+    if (dbns[f] == 0) continue;
+    src[num]   = dbns[f];
+    fbn[num++] = f;
+  }
+
+  i32 j = 1;
+  while (j < num && src[j] == src[0] + j) ++j;
+  if (j >= num) {                               // already contiguous
+    fsUnlock();
+    return 0;
+  }
+
+  defragFreeMap(isFree);
+  i32 at = defragRun(isFree, src, num);
+  if (at == 0) {
+    fsUnlock();
+    return -1;
+  }
+  for (j = 0; j < num; ++j) {                   // reserve the run
+    if (src[j] == at + j) continue;
+    isFree[at + j] = 0;
+    statsAlloc();
+    HOOK(HKALLOC, at + j, 0);
+  }
+  defragRelink(isFree);
+  fsUnlock();
+
+  i32 moved = 0;
+  i32 live  = 1;                                // file unchanged so far?
+  for (j = 0; j < num; ++j) {
+    if (src[j] == at + j) continue;
+    live = live && !atomic_load(&g_defragStop);
+    fsLock();
+    if (live) live = defragMove(inum, fbn[j], src[j], at + j);
+    if (!live) bfsFreeBlock(at + j);            // give back the reservation
+    fsUnlock();
+    if (!live) continue;
+    ++moved;
+    defragPace(rate);
+  }
+  return moved;
+}
+
+
+
+// ============================================================================
+// Defragment the BFS disk in use while it stays mounted, moving at most
+// 'rate' blocks per second (0: no cap).  Each fragmented file, in inum order,
+// is moved into the lowest free run that holds it; a file packed low can make
+// room for one skipped, so passes repeat while they make progress.  The
+// Freelist is left in DBN order.  Fill 'rep'.  Return 0
+// ============================================================================
+i32 defragOnline(i32 rate, DefragReport* rep) {
+  if (rep == NULL) FATAL(ENULLPTR);
+  memset(rep, 0, sizeof(DefragReport));
+  u64 t0 = histNow();
+
+  fsLock();
+  rep->files = defragScan(&rep->extentsBefore);
+  fsUnlock();
+
+  u8 moved[NUMINODES] = {0};
+  for (i32 pass = 0; pass < NUMINODES; ++pass) {
+    i32 progress = 0;
+    rep->skipped = 0;
+    for (i32 inum = 0; inum < NUMINODES; ++inum) {
+      if (atomic_load(&g_defragStop)) break;
+      i32 n = defragFile(inum, rate);
+      if (n < 0) ++rep->skipped;
+      if (n <= 0) continue;
+      rep->blocks += n;
+      moved[inum]  = 1;
+      progress     = 1;
+    }
+    if (!progress || rep->skipped == 0 || atomic_load(&g_defragStop)) break;
+  }
+  for (i32 inum = 0; inum < NUMINODES; ++inum) rep->moved += moved[inum];
+
+  fsLock();                                     // blocks moved from went
+  if (rep->blocks > 0) {                        // back to the Freelist head
+    u8 isFree[BLOCKSPERDISK];
+    defragFreeMap(isFree);
+    defragRelink(isFree);
+  }
+  defragScan(&rep->extentsAfter);
+  fsUnlock();
+
+  rep->ns = histNow() - t0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of the background defragmenter: an online pass every DEFRAGIDLEMS,
+// until stopped, added up into g_defragRep
+// ============================================================================
+static void* defragThread(void* p) {
+  (void)p;
+  DefragReport* tot = &g_defragRep;
+  memset(tot, 0, sizeof(DefragReport));
+
+  for (i32 pass = 0; !atomic_load(&g_defragStop); ++pass) {
+    DefragReport rep;
+    defragOnline(g_defragRate, &rep);
+    if (pass == 0) tot->extentsBefore = rep.extentsBefore;
+    tot->files        = rep.files;
+    tot->skipped      = rep.skipped;
+    tot->extentsAfter = rep.extentsAfter;
+    tot->moved       += rep.moved;
+    tot->blocks      += rep.blocks;
+    tot->ns          += rep.ns;
+
+    for (i32 ms = 0; ms < DEFRAGIDLEMS; ms += DEFRAGSLICEMS) {
+      if (atomic_load(&g_defragStop)) break;
+      histSleep(DEFRAGSLICEMS);
+    }
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Start defragmenting the disk in use in the background, online, at most
+// 'rate' blocks per second (0: no cap), until defragStop.  The disk must be
+// mounted, and stay so.  Return 0
+// ============================================================================
+i32 defragStart(i32 rate) {
+  if (g_defragRun) defragStop(NULL);
+  atomic_store(&g_defragStop, 0);
+  g_defragRate = rate;
+  pthread_create(&g_defragTid, NULL, defragThread, NULL);
+  g_defragRun = 1;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop the background defragmenter, after the block it is moving, and wait
+// for it.  Fill 'rep', if not NULL, with what it did over all its passes.
+// Return 0
+// ============================================================================
+i32 defragStop(DefragReport* rep) {
+  if (!g_defragRun) return 0;
+  atomic_store(&g_defragStop, 1);
+  pthread_join(g_defragTid, NULL);
+  atomic_store(&g_defragStop, 0);
+  g_defragRun = 0;
+  if (rep != NULL) memcpy(rep, &g_defragRep, sizeof(DefragReport));
+  return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef DEFRAG_H
+#define DEFRAG_H
+
+// ===================================================================
+// defrag.h - defragmenter.  Moves each file's blocks into one run of
+// consecutive DBNs - its indirect block first, then its data blocks
+// in FBN order - and rewrites its direct and indirect maps to match.
+//
+// defragOffline rewrites the whole image at once, packing every file
+// from MINDBN up and leaving the free space as one run at the end.
+// The disk must not be in use, and must pass fsck.
+//
+// defragOnline works on a mounted disk while fs.h calls go on.  Each
+// fragmented file gets the lowest run of free blocks that holds it,
+// reserved off the Freelist, then its blocks are moved one at a time,
+// each move under fsLock, so readers wait for one block copy, or one
+// rewrite of the Freelist, at most.
+// 'rate' caps the blocks moved per second (0: no cap).  A block is
+// copied before its map entry is switched, and only then freed, so a
+// crash mid-move loses no data; blocks reserved but not yet used show
+// up as leaked in fsck, and nothing worse.  defragStart runs it in a
+// background thread, pass after pass, until defragStop
+// ===================================================================
+
+#include "alias.h"
+
+#define DEFRAGIDLEMS  250         // background: pause between passes
+
+typedef struct {          // DefragReport
+  i32 files;              // files in the Directory
+  i32 moved;              // files whose blocks were moved
+  i32 skipped;            // files left fragmented: no free run would fit
+  i32 blocks;             // blocks moved, indirect blocks included
+  i32 extentsBefore;      // data extents, summed over files, before
+  i32 extentsAfter;       //   ... and after
+  u64 ns;                 // time taken
+} DefragReport;
+
+i32 defragOffline(DefragReport* rep);
+i32 defragOnline (i32 rate, DefragReport* rep);
+i32 defragStart  (i32 rate);
+i32 defragStop   (DefragReport* rep);
+
+#endif
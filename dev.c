@@ -0,0 +1,301 @@
+// ============================================================================
+// dev.c - host I/O backends beneath bio
+// ============================================================================
+
+#define _GNU_SOURCE                     // for O_DIRECT
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bio.h"
+#include "dev.h"
+#include "stats.h"
+
+static str g_devPath    = NULL;         // disk image; NULL => not open
+static i32 g_devBackend = BIOSTDIO;
+static i32 g_devFd      = -1;           // all but BIOSTDIO
+static i8* g_devMem     = NULL;         // BIOMMAP mapping, BIORAM image
+static i64 g_devSize    = 0;            // bytes in the image
+
+static _Thread_local i8 t_devBounce[DEVMAXIO]         // O_DIRECT buffer
+  __attribute__((aligned(4096)));
+
+
+
+// ============================================================================
+// Release whatever the open backend holds.  Write nothing back: see devSync
+// ============================================================================
+i32 devClose() {
+  if (g_devBackend == BIOMMAP && g_devMem != NULL) {
+    munmap(g_devMem, g_devSize);
+  }
+  if (g_devBackend == BIORAM) free(g_devMem);
+  g_devMem = NULL;
+  if (g_devFd >= 0) close(g_devFd);
+  g_devFd   = -1;
+  g_devPath = NULL;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Push the file at 'path' to stable storage and drop it from the host page
+// cache, so the next access goes to the device.  Return 0 or DEVNODISK
+// ============================================================================
+i32 devEvict(str path) {
+  i32 fd = open(path, O_RDONLY);
+  if (fd < 0) return DEVNODISK;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Move 'numb' bytes between offset 'off' of the disk image and 'buf'.  'rw'
+// is IOREAD or IOWRITE.  Return 0, DEVNODISK, or DEVBADIO
+// ============================================================================
+i32 devIO(i64 off, void* buf, i32 numb, i32 rw) {
+  if (numb <= 0 || numb > DEVMAXIO || off < 0 || off + numb > g_devSize) {
+    return DEVBADIO;
+  }
+  ssize_t done = 0;
+
+  switch (g_devBackend) {
+    case BIOSTDIO: {
+      FILE* fp = fopen(g_devPath, "rb+");
+      if (fp == NULL) return DEVNODISK;
+      if (fseek(fp, off, SEEK_SET) != 0) { fclose(fp); return DEVBADIO; }
+      done = (rw == IOREAD) ? fread (buf, 1, numb, fp)
+                            : fwrite(buf, 1, numb, fp);
+      fclose(fp);
+      break;
+    }
+    case BIOPREAD:
+      done = (rw == IOREAD) ? pread (g_devFd, buf, numb, off)
+                            : pwrite(g_devFd, buf, numb, off);
+      break;
+
+    case BIODIRECT:
+      if (rw == IOWRITE) memcpy(t_devBounce, buf, numb);
+      done = (rw == IOREAD) ? pread (g_devFd, t_devBounce, numb, off)
+                            : pwrite(g_devFd, t_devBounce, numb, off);
+      if (rw == IOREAD) memcpy(buf, t_devBounce, numb);
+      break;
+
+    case BIOAIO: {
+      struct aiocb cb;
+      memset(&cb, 0, sizeof(cb));
+      cb.aio_fildes = g_devFd;
+      cb.aio_buf    = buf;
+      cb.aio_nbytes = numb;
+      cb.aio_offset = off;
+      i32 ret = (rw == IOREAD) ? aio_read(&cb) : aio_write(&cb);
+      if (ret != 0) return DEVBADIO;
+
+      const struct aiocb* list[1] = { &cb };
+      while (aio_error(&cb) == EINPROGRESS) aio_suspend(list, 1, NULL);
+      done = aio_return(&cb);
+      break;
+    }
+    case BIOMMAP:
+    case BIORAM:
+      if (rw == IOREAD) memcpy(buf, g_devMem + off, numb);
+      else              memcpy(g_devMem + off, buf, numb);
+      done = numb;
+      break;
+  }
+
+  return (done == numb) ? 0 : DEVBADIO;
+}
+
+
+
+// ============================================================================
+// Open the disk image at 'path', of 'size' bytes, for backend 'backend',
+// closing whatever was open before.  Return 0, DEVNODISK, or DEVNOSUPPORT
+// ============================================================================
+i32 devOpen(str path, i32 backend, i64 size) {
+  devClose();
+  g_devBackend = backend;
+  g_devSize    = size;
+  if (backend == BIOSTDIO) { g_devPath = path; return 0; }
+
+  i32 flags = O_RDWR;
+  if (backend == BIODIRECT) flags |= O_DIRECT;
+
+  g_devFd = open(path, flags);
+  if (g_devFd < 0) {
+    if (backend == BIODIRECT && errno == EINVAL) return DEVNOSUPPORT;
+    return DEVNODISK;
+  }
+
+  i32 ret = 0;
+  if (backend == BIODIRECT) {                   // some filesystems accept
+    if (pread(g_devFd, t_devBounce, 512, 0) != 512) {   // O_DIRECT but not
+      ret = DEVNOSUPPORT;                       // 512-byte transfers
+    }
+  }
+
+  if (backend == BIOMMAP) {
+    struct stat sb;
+    if (fstat(g_devFd, &sb) != 0 ||
+        (sb.st_size < size && ftruncate(g_devFd, size) != 0)) {
+      ret = DEVNOSUPPORT;
+    } else {
+      void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     g_devFd, 0);
+      if (p == MAP_FAILED) ret = DEVNOSUPPORT; else g_devMem = p;
+    }
+  }
+
+  if (backend == BIORAM) {
+    g_devMem = calloc(size, 1);
+    if (g_devMem == NULL ||
+        pread(g_devFd, g_devMem, size, 0) < 0) ret = DEVNOSUPPORT;
+  }
+
+  if (ret != 0) { devClose(); return ret; }
+  g_devPath = path;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Map POSIX shared-memory segment 'name', of at least 'size' bytes.  With
+// 'create', make it, or take over an old one, read-write; otherwise attach
+// to an existing one, read-only.  Return the mapping, or NULL
+// ============================================================================
+void* devShmMap(str name, i64 size, i32 create) {
+  i32 fd = create ? shm_open(name, O_RDWR | O_CREAT, 0644)
+                  : shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return NULL;
+
+  struct stat sb;
+  i32 ok = create ? (ftruncate(fd, size) == 0)
+                  : (fstat(fd, &sb) == 0 && sb.st_size >= size);
+  void* p = MAP_FAILED;
+  if (ok) {
+    p = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ,
+             MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  return (p == MAP_FAILED) ? NULL : p;
+}
+
+
+
+// ============================================================================
+// Unmap 'p', of 'size' bytes, from devShmMap.  If 'name' is not NULL, also
+// remove the segment.  Return 0
+// ============================================================================
+i32 devShmUnmap(void* p, i64 size, str name) {
+  if (p != NULL) munmap(p, size);
+  if (name != NULL) shm_unlink(name);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Wait up to 'ms' milliseconds for a connection on listening socket 'fd',
+// and accept it.  Return the connected socket, or DEVBADIO if none came
+// ============================================================================
+i32 devSockAccept(i32 fd, i32 ms) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  if (poll(&pfd, 1, ms) <= 0) return DEVBADIO;
+  i32 c = accept(fd, NULL, NULL);
+  return (c < 0) ? DEVBADIO : c;
+}
+
+
+
+// ============================================================================
+// Close socket 'fd'.  If 'path' is not NULL, also remove the socket file
+// it listened on.  Return 0
+// ============================================================================
+i32 devSockClose(i32 fd, str path) {
+  if (fd >= 0) close(fd);
+  if (path != NULL) unlink(path);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Listen on a Unix domain stream socket at 'path', replacing any socket file
+// left there.  Return the listening socket, or DEVNOSUPPORT
+// ============================================================================
+i32 devSockListen(str path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) return DEVNOSUPPORT;
+  strcpy(addr.sun_path, path);
+
+  i32 fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return DEVNOSUPPORT;
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 8) != 0) {
+    close(fd);
+    return DEVNOSUPPORT;
+  }
+  return fd;
+}
+
+
+
+// ============================================================================
+// Receive up to 'numb' bytes from socket 'fd' into 'buf', waiting up to 'ms'
+// milliseconds for them.  Return the number received; 0 if none
+// ============================================================================
+i32 devSockRecv(i32 fd, void* buf, i32 numb, i32 ms) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  if (poll(&pfd, 1, ms) <= 0) return 0;
+  ssize_t n = recv(fd, buf, numb, 0);
+  return (n < 0) ? 0 : (i32)n;
+}
+
+
+
+// ============================================================================
+// Send all 'numb' bytes of 'buf' on socket 'fd'.  A peer that has gone away
+// fails the call, rather than raising SIGPIPE.  Return 0 or DEVBADIO
+// ============================================================================
+i32 devSockSend(i32 fd, void* buf, i32 numb) {
+  i8* p = (i8*)buf;
+  while (numb > 0) {
+    ssize_t n = send(fd, p, numb, MSG_NOSIGNAL);
+    if (n <= 0) return DEVBADIO;
+    p    += n;
+    numb -= n;
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Hand the image to the kernel, for BIORAM, which holds it all in memory.
+// Like the other backends, this does not fsync.  Return 0 or DEVBADIO
+// ============================================================================
+i32 devSync() {
+  if (g_devBackend != BIORAM || g_devMem == NULL) return 0;
+  ssize_t n = pwrite(g_devFd, g_devMem, g_devSize, 0);
+  return (n == g_devSize) ? 0 : DEVBADIO;
+}
@@ -0,0 +1,36 @@
+#ifndef DEV_H
+#define DEV_H
+
+// ===================================================================
+// dev.h - host I/O backends beneath bio.  Each moves whole blocks
+// between memory and the disk image file with a different system
+// interface; bio.h names them (BIOSTDIO, BIOPREAD, ...).
+//
+// dev.c talks to the host directly, so it knows nothing of BFS: bio
+// passes in the image size and byte offsets, and turns the codes dev
+// returns into BFS errors.  For the same reason, it also maps the
+// shared-memory segments mon.c publishes statistics through, and
+// holds the Unix domain sockets metrics.c serves them on
+// ===================================================================
+
+#include "alias.h"
+
+#define DEVNODISK     -1          // disk image cannot be opened
+#define DEVNOSUPPORT  -2          // host cannot run this backend on it
+#define DEVBADIO      -3          // short or failed transfer
+#define DEVMAXIO      4096        // largest transfer devIO accepts
+
+i32 devClose();
+i32 devEvict(str path);
+i32 devIO   (i64 off, void* buf, i32 numb, i32 rw);
+i32 devOpen (str path, i32 backend, i64 size);
+i32 devSync ();
+void* devShmMap  (str name, i64 size, i32 create);
+i32   devShmUnmap(void* p,  i64 size, str name);
+i32   devSockAccept(i32 fd, i32 ms);
+i32   devSockClose (i32 fd, str path);
+i32   devSockListen(str path);
+i32   devSockRecv  (i32 fd, void* buf, i32 numb, i32 ms);
+i32   devSockSend  (i32 fd, void* buf, i32 numb);
+
+#endif
@@ -30,7 +30,7 @@ void RepError(i32 e) {
     case EBADINUM:
       printf("\nERROR: Bad Inum: negative or too large \n");   pause(); break;
     case EBADCURS:
-      printf("\nERROR: Bad cursor within file \n");           pause(); break;
+      printf("\nERROR: Bad cursor within file \n");            pause(); break;
     case EBADREAD:
       printf("\nERROR: Error writing to BFS disk \n");         pause(); break;
     case EBADWRITE:
@@ -63,8 +63,18 @@ void RepError(i32 e) {
       printf("\nERROR: Function Note Yet Implemented \n");     pause(); break;
     case EOFTFULL:
       printf("\nERROR: OpenFileTable is full \n");             pause(); break;
+    case EFILEOPEN:
+      printf("\nERROR: File is open \n");                      pause(); break;
+    case EBADHOOK:
+      printf("\nERROR: Invalid tracepoint \n");                pause(); break;
+    case ENOBACKEND:
+      printf("\nERROR: bio backend not available \n");         pause(); break;
     case EBADWHENCE:
       printf("\nERROR: Invalid 'whence' in fsSeek \n");        pause(); break;
+    case EBADDISK:
+      printf("\nERROR: BFS disk inconsistent: run fsck \n");   pause(); break;
+    case ESTALESHM:
+      printf("\nERROR: Statistics segment not updating \n");   pause(); break;
     default:
       printf("\nERROR: Miscellaneous error \n");               pause(); break;
   }
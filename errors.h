@@ -29,6 +29,11 @@ void RepTest(int err, str file, int line);
 #define ENULLPTR    -19   // about to deref a NULL pointer
 #define ENYI        -20   // not yet implemented
 #define EOFTFULL    -21   // OpenFileTable is full
+#define EFILEOPEN   -22   // File is open, so cannot be deleted
+#define EBADHOOK    -23   // invalid tracepoint number
+#define ENOBACKEND  -24   // bio backend not available on this host
+#define EBADDISK    -25   // BFS disk inconsistent: fsck finds errors
+#define ESTALESHM   -26   // shared-memory segment stuck part way updated
 
 void pause();
 void RepError(i32 ret);
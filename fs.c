@@ -2,16 +2,34 @@
 // fs.c - user FileSytem API
 // ============================================================================
 
+#include <pthread.h>
+
 #include "bfs.h"
 #include "fs.h"
+#include "prof.h"
+#include "stats.h"
+#include "trace.h"
+
+// One lock serializes every fs.h call, so BFS can be used from several
+// threads.  The calls below share the Open File Table and read-modify-write
+// the metadata blocks, so finer locking would buy little on one Dir block
+
+static pthread_mutex_t g_fsLock = PTHREAD_MUTEX_INITIALIZER;
 
 // ============================================================================
-// Close the file currently open on file descriptor 'fd'.
+// Close the file currently open on file descriptor 'fd'.  Return 0, or
+// EBADINUM if it is not open
 // ============================================================================
 i32 fsClose(i32 fd) {
+    i32 prev = statsEnter(OPCLOSE);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsFdToInum(fd);
-    bfsDerefOFT(inum);
-    return 0;
+    statsFile(inum);
+    i32 ret = bfsDerefOFT(inum);
+    statsLeave(prev);
+    traceOp(OPCLOSE, fd, 0, 0, 0, NULL);
+    pthread_mutex_unlock(&g_fsLock);
+    return ret;
 }
 
 
@@ -20,9 +38,278 @@ i32 fsClose(i32 fd) {
 // On success, return its file descriptor.  On failure, EFNF
 // ============================================================================
 i32 fsCreate(str fname) {
+    i32 prev = statsEnter(OPCREATE);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsCreateFile(fname);
-    if (inum == EFNF) return EFNF;
-    return bfsInumToFd(inum);
+    if (inum == EFNF) {
+        statsError();
+    } else {
+        statsForget(inum);                  // counts of the file it replaced
+        statsFile(inum);
+        statsName(inum, fname);
+    }
+    statsLeave(prev);
+    i32 fd = (inum == EFNF) ? EFNF : bfsInumToFd(inum);
+    traceOp(OPCREATE, fd, 0, 0, fd, fname);
+    pthread_mutex_unlock(&g_fsLock);
+    return fd;
+}
+
+
+// ============================================================================
+// Delete the file called 'fname', freeing its blocks.  The file must not be
+// open.  On success, return 0.  On failure, EFNF or EFILEOPEN
+// ============================================================================
+i32 fsDelete(str fname) {
+    i32 prev = statsEnter(OPDELETE);
+    pthread_mutex_lock(&g_fsLock);
+    i32 ret = bfsDeleteFile(fname);
+    if (ret != 0) statsError();
+    statsLeave(prev);
+    traceOp(OPDELETE, 0, 0, 0, ret, fname);
+    pthread_mutex_unlock(&g_fsLock);
+    return ret;
+}
+
+
+// What fsExplain tracks as it walks a request through, in step with the
+// code of fsRead, fsWrite and the bfs calls they make: the file's Inode and
+// indirect block, and the head of the Freelist, as the request would leave
+// them
+
+typedef struct {                      // FsPlanCtx
+    FsPlan* plan;
+    Inode   inode;
+    i16     ind[I16SPERBLOCK];        // indirect block, if inode.indirect
+    i32     firstFree;
+    i32     cache;                    // block cache size
+    u8      seen[BLOCKSPERDISK];      // blocks the request touched already
+} FsPlanCtx;
+
+
+// ============================================================================
+// Record one bio call of the plan, on block 'dbn' in role 'bc'.  It would
+// hit in the block cache if the cache holds the block now, or if the request
+// touched it already (assuming nothing is evicted meanwhile)
+// ============================================================================
+static void fsPlanStep(FsPlanCtx* ctx, i32 dbn, i32 bc, i32 rw) {
+    FsPlan* plan = ctx->plan;
+    i32 hit = ctx->cache > 0 && (ctx->seen[dbn] || bioCached(dbn));
+    ctx->seen[dbn] = 1;
+
+    if (plan->numSteps < FSPLANSTEPS) {
+        FsStep* s = &plan->steps[plan->numSteps];
+        s->dbn = dbn;
+        s->bc  = bc;
+        s->rw  = rw;
+        s->hit = hit;
+    }
+    ++plan->numSteps;
+    if (bc == BCDATA) ++plan->dataIOs; else ++plan->metaIOs;
+    plan->hits += hit;
+}
+
+
+// ============================================================================
+// Plan bfsFindFreeBlock.  Return the DBN it would take, or -1 if the
+// Freelist is empty
+// ============================================================================
+static i32 fsPlanFind(FsPlanCtx* ctx) {
+    fsPlanStep(ctx, DBNSUPER, BCSUPER, IOREAD);
+    i32 dbn = ctx->firstFree;
+    if (dbn == 0) {
+        ctx->plan->full = 1;
+        return -1;
+    }
+
+    i16 buf16[I16SPERBLOCK];
+    bioPeek(dbn, buf16);
+    fsPlanStep(ctx, dbn, BCFREE, IOREAD);
+    fsPlanStep(ctx, DBNSUPER, BCSUPER, IOWRITE);
+    ctx->firstFree = buf16[0];
+    ++ctx->plan->allocs;
+    return dbn;
+}
+
+
+// ============================================================================
+// Plan bfsAllocBlock for FBN 'fbn'.  Return the DBN it would map, or -1 if
+// the disk is full.  The first indirect FBN also allocates the indirect
+// block, which starts empty rather than being read
+// ============================================================================
+static i32 fsPlanAlloc(FsPlanCtx* ctx, i32 fbn) {
+    i32 dbn = fsPlanFind(ctx);
+    if (dbn < 0) return -1;
+    fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);
+
+    if (fbn < NUMDIRECT) {
+        ctx->inode.direct[fbn] = dbn;
+        fsPlanStep(ctx, DBNINODES, BCINODE, IOWRITE);
+        return dbn;
+    }
+
+    i32 dbnIndirect = ctx->inode.indirect;
+    if (dbnIndirect == 0) {                 // starts empty: no read
+        dbnIndirect = fsPlanFind(ctx);
+        if (dbnIndirect < 0) return -1;
+        ctx->inode.indirect = dbnIndirect;
+        memset(ctx->ind, 0, sizeof(ctx->ind));
+        fsPlanStep(ctx, DBNINODES, BCINODE, IOWRITE);
+    } else {
+        fsPlanStep(ctx, dbnIndirect, BCINDIRECT, IOREAD);
+    }
+    ctx->ind[fbn - NUMDIRECT] = dbn;
+    fsPlanStep(ctx, dbnIndirect, BCINDIRECT, IOWRITE);
+    return dbn;
+}
+
+
+// ============================================================================
+// Plan bfsFbnToDbn for FBN 'fbn'.  Return the DBN mapped, or ENODBN if none
+// ============================================================================
+static i32 fsPlanMap(FsPlanCtx* ctx, i32 fbn) {
+    fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);
+    if (fbn < NUMDIRECT) {
+        i32 dbn = ctx->inode.direct[fbn];
+        return (dbn == 0) ? ENODBN : dbn;
+    }
+
+    if (ctx->inode.indirect == 0) return ENODBN;
+
+    fsPlanStep(ctx, ctx->inode.indirect, BCINDIRECT, IOREAD);
+    i32 dbn = ctx->ind[fbn - NUMDIRECT];
+    return (dbn == 0) ? ENODBN : dbn;
+}
+
+
+// ============================================================================
+// Plan fsRead of 'len' bytes from 'offset'
+// ============================================================================
+static void fsPlanRead(FsPlanCtx* ctx, i32 offset, i32 len) {
+    FsPlan* plan = ctx->plan;
+    fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);        // bfsGetSize
+
+    i32 bytes = (offset + len > plan->size) ? plan->size - offset : len;
+    if (bytes <= 0) return;
+
+    i32 fbn  = offset / BYTESPERBLOCK;
+    i32 done = -(offset % BYTESPERBLOCK);
+    for (; done < bytes; done += BYTESPERBLOCK, ++fbn) {
+        i32 dbn = fsPlanMap(ctx, fbn);
+        if (dbn != ENODBN) fsPlanStep(ctx, dbn, BCDATA, IOREAD);
+    }
+    plan->bytes = bytes;
+}
+
+
+// ============================================================================
+// Plan fsWrite of 'len' bytes at 'offset': extend the file, zero any gap
+// past its old EOF, set its size, then write block by block
+// ============================================================================
+static void fsPlanWrite(FsPlanCtx* ctx, i32 offset, i32 len) {
+    FsPlan* plan = ctx->plan;
+    i32 size = plan->size;
+    fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);        // bfsGetSize
+
+    if (offset + len > size) {
+        fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);    // bfsExtend
+        i32 newFbn = (offset + len - 1) / BYTESPERBLOCK;
+        i32 fbn    = (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+        for (; fbn <= newFbn; ++fbn) {
+            if (fsPlanAlloc(ctx, fbn) < 0) return;
+        }
+
+        for (i32 gap = size; gap < offset; ) {
+            i32 fbn = gap / BYTESPERBLOCK;
+            i32 off = gap % BYTESPERBLOCK;
+            i32 dbn = fsPlanMap(ctx, fbn);
+            if (dbn == ENODBN) dbn = fsPlanAlloc(ctx, fbn);
+            if (dbn < 0) return;
+            if (off != 0) fsPlanStep(ctx, dbn, BCDATA, IOREAD);
+            fsPlanStep(ctx, dbn, BCDATA, IOWRITE);
+            gap += BYTESPERBLOCK - off;
+        }
+
+        fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);    // bfsSetSize
+        fsPlanStep(ctx, DBNINODES, BCINODE, IOREAD);
+        fsPlanStep(ctx, DBNINODES, BCINODE, IOWRITE);
+        ctx->inode.size = offset + len;
+    }
+
+    i32 fbn  = offset / BYTESPERBLOCK;
+    i32 off  = offset % BYTESPERBLOCK;
+    for (i32 done = 0; done < len; ++fbn) {
+        i32 dbn = fsPlanMap(ctx, fbn);
+        if (dbn == ENODBN) {
+            dbn = fsPlanAlloc(ctx, fbn);
+        } else if (dbn >= 0 && (off != 0 || len - done < BYTESPERBLOCK)) {
+            fsPlanStep(ctx, dbn, BCDATA, IOREAD);
+        }
+        if (dbn < 0) return;
+        fsPlanStep(ctx, dbn, BCDATA, IOWRITE);
+        done += BYTESPERBLOCK - off;
+        off = 0;
+    }
+    plan->bytes = len;
+}
+
+
+// ============================================================================
+// Explain, without doing it, what a read ('op' OPREAD) or write (OPWRITE) of
+// 'len' bytes at 'offset', in the file open on 'fd', would do: fill 'plan'
+// with every bio call it would make, in order, on which block and in what
+// role, and whether the block cache would serve it; how many would touch
+// metadata and how many data; and how many blocks it would allocate.  The
+// blocks the plan depends on are read with bioPeek, so nothing - cache,
+// counters, traces, the file's cursor - changes.  On success, return 0.
+// If the request is not one fsRead or fsWrite would accept, return ENYI,
+// EBADCURS, ENEGNUMB or EBADFBN; if 'fd' is not a file open now, EBADINUM
+// ============================================================================
+i32 fsExplain(i32 fd, i32 op, i32 offset, i32 len, FsPlan* plan) {
+    if (plan == NULL) FATAL(ENULLPTR);
+    memset(plan, 0, sizeof(FsPlan));
+    plan->op     = op;
+    plan->offset = offset;
+    plan->len    = len;
+
+    if (op != OPREAD && op != OPWRITE) return ENYI;
+    if (offset < 0) return EBADCURS;
+    if (len <= 0)   return ENEGNUMB;
+    if (op == OPWRITE && (offset + len - 1) / BYTESPERBLOCK > MAXFBN) {
+        return EBADFBN;
+    }
+
+    pthread_mutex_lock(&g_fsLock);
+    i32 inum = bfsFdToInum(fd);
+    i32 open = 0;
+    for (i32 i = 0; i < NUMOFTENTRIES && inum <= MAXINUM; ++i) {
+        open |= (g_oft[i].inum == inum && g_oft[i].refs > 0);
+    }
+    if (!open) {                              // out of range, or not open
+        pthread_mutex_unlock(&g_fsLock);
+        return EBADINUM;
+    }
+
+    FsPlanCtx* ctx = calloc(1, sizeof(FsPlanCtx));
+    if (ctx == NULL) FATAL(ENOMEM);
+    ctx->plan  = plan;
+    ctx->cache = bioCache();
+
+    i8 buf[BYTESPERBLOCK];
+    bioPeek(DBNINODES, buf);
+    ctx->inode = ((Inode*)buf)[inum];
+    if (ctx->inode.indirect != 0) bioPeek(ctx->inode.indirect, ctx->ind);
+    bioPeek(DBNSUPER, buf);
+    ctx->firstFree = ((Super*)buf)->firstFree;
+    plan->size = ctx->inode.size;
+
+    if (op == OPREAD) fsPlanRead (ctx, offset, len);
+    else              fsPlanWrite(ctx, offset, len);
+    plan->newSize = ctx->inode.size;
+    pthread_mutex_unlock(&g_fsLock);
+
+    free(ctx);
+    return 0;
 }
 
 
@@ -31,7 +318,10 @@ i32 fsCreate(str fname) {
 // Freelist.  On succes, return 0.  On failure, abort
 // ============================================================================
 i32 fsFormat() {
-    FILE *fp = fopen(BFSDISK, "w+b");
+    i32 prev = statsEnter(OPFORMAT);
+    pthread_mutex_lock(&g_fsLock);
+    bioClose();                               // drop what bio holds open
+    FILE *fp = fopen(bioDisk(), "w+b");
     if (fp == NULL) FATAL(EDISKCREATE);
 
     i32 ret = bfsInitSuper(fp);               // initialize Super block
@@ -59,6 +349,39 @@ i32 fsFormat() {
     }
 
     fclose(fp);
+    statsLeave(prev);
+    traceOp(OPFORMAT, 0, 0, 0, 0, NULL);
+    pthread_mutex_unlock(&g_fsLock);
+    return 0;
+}
+
+
+// ============================================================================
+// Fill 'st' with a snapshot of the counters for this volume: operation counts,
+// bytes moved, block I/Os, block cache hits, allocation rate, errors and Open
+// File Table occupancy.  Safe to call while other threads use the file
+// system; each counter is exact, but they are not sampled at one instant
+// ============================================================================
+i32 fsGetStats(FsStats* st) {
+    statsSummary(st);
+    st->dirty   = bioDirty();
+    st->oftSize = NUMOFTENTRIES;
+    pthread_mutex_lock(&g_fsLock);
+    for (i32 i = 0; i < NUMOFTENTRIES; ++i) {
+        if (g_oft[i].refs > 0) ++st->oftUsed;
+    }
+    pthread_mutex_unlock(&g_fsLock);
+    return 0;
+}
+
+
+// ============================================================================
+// Hold off every other fs.h call, for a tool that changes the disk beneath
+// them (eg: the online defragmenter).  While holding it, call bfs.h and bio.h
+// directly, never fs.h, which would deadlock.  Hold it briefly: readers wait
+// ============================================================================
+i32 fsLock() {
+    pthread_mutex_lock(&g_fsLock);
     return 0;
 }
 
@@ -67,9 +390,14 @@ i32 fsFormat() {
 // Mount the BFS disk.  It must already exist
 // ============================================================================
 i32 fsMount() {
-    FILE *fp = fopen(BFSDISK, "rb");
+    i32 prev = statsEnter(OPMOUNT);
+    pthread_mutex_lock(&g_fsLock);
+    FILE *fp = fopen(bioDisk(), "rb");
     if (fp == NULL) FATAL(ENODISK);           // BFSDISK not found
     fclose(fp);
+    statsLeave(prev);
+    traceOp(OPMOUNT, 0, 0, 0, 0, NULL);
+    pthread_mutex_unlock(&g_fsLock);
     return 0;
 }
 
@@ -79,9 +407,20 @@ i32 fsMount() {
 // descriptor.  On failure, return EFNF
 // ============================================================================
 i32 fsOpen(str fname) {
+    i32 prev = statsEnter(OPOPEN);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsLookupFile(fname);        // lookup 'fname' in Directory
-    if (inum == EFNF) return EFNF;
-    return bfsInumToFd(inum);
+    if (inum == EFNF) {
+        statsError();
+    } else {
+        statsFile(inum);
+        statsName(inum, fname);
+    }
+    statsLeave(prev);
+    i32 fd = (inum == EFNF) ? EFNF : bfsInumToFd(inum);
+    traceOp(OPOPEN, fd, 0, 0, fd, fname);
+    pthread_mutex_unlock(&g_fsLock);
+    return fd;
 }
 
 // ============================================================================
@@ -92,13 +431,21 @@ i32 fsOpen(str fname) {
 i32 fsRead(i32 fd, i32 numb, void *buf) {
     if (numb <= 0) FATAL(ENEGNUMB);
 
+    i32 prev = statsEnter(OPREAD);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsFdToInum(fd);      // Convert file descriptor to inode number
+    statsFile(inum);
     i32 cursor = bfsTell(fd);        // Get curr cursor position
     i32 size = bfsGetSize(inum);     // Get file size
 
     // Calculate max bytes to read
     i32 bytesToRead = (cursor + numb > size) ? (size - cursor) : numb;
-    if (bytesToRead <= 0) return 0;  // End of file / nothing to read
+    if (bytesToRead <= 0) {          // End of file / nothing to read
+        statsLeave(prev);
+        traceOp(OPREAD, fd, cursor, numb, 0, NULL);
+        pthread_mutex_unlock(&g_fsLock);
+        return 0;
+    }
 
     i8 *buf8 = (i8 *) buf;
     i32 bytesRead = 0;
@@ -114,7 +461,9 @@ i32 fsRead(i32 fd, i32 numb, void *buf) {
 
         // If block exists, read it; otherwise leave as zeroed
         if (dbn != ENODBN) {
+            PROFENTER(PROFFS, PROFDATA);
             bioRead(dbn, blockBuf);
+            PROFLEAVE();
         }
 
         // Calculate bytes to read from this block
@@ -124,7 +473,9 @@ i32 fsRead(i32 fd, i32 numb, void *buf) {
         }
 
         // Copy data from block buffer to output buffer
+        PROFENTER(PROFFS, PROFCOPY);
         memcpy(buf8 + bytesRead, blockBuf + offset, blockBytesToRead);
+        PROFLEAVE();
 
         bytesRead += blockBytesToRead;
         offset = 0;                  // Reset offset for next blocks
@@ -134,6 +485,10 @@ i32 fsRead(i32 fd, i32 numb, void *buf) {
     // Update cursor position
     bfsSetCursor(inum, cursor + bytesRead);
 
+    statsBytes(IOREAD, bytesRead);
+    statsLeave(prev);
+    traceOp(OPREAD, fd, cursor, numb, bytesRead, NULL);
+    pthread_mutex_unlock(&g_fsLock);
     return bytesRead;   // Actual num of bytes read
 }
 
@@ -151,8 +506,11 @@ i32 fsSeek(i32 fd, i32 offset, i32 whence) {
 
     if (offset < 0) FATAL(EBADCURS);
 
+    i32 prev = statsEnter(OPSEEK);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsFdToInum(fd);
     i32 ofte = bfsFindOFTE(inum);
+    statsFile(inum);
 
     switch (whence) {
         case SEEK_SET:
@@ -162,12 +520,15 @@ i32 fsSeek(i32 fd, i32 offset, i32 whence) {
             g_oft[ofte].curs += offset;
             break;
         case SEEK_END: {
-            i32 end = fsSize(fd);
+            i32 end = bfsGetSize(inum);     // not fsSize: we hold g_fsLock
             g_oft[ofte].curs = end + offset;
             break;
         }
         default: FATAL(EBADWHENCE);
     }
+    statsLeave(prev);
+    traceOp(OPSEEK, fd, offset, whence, 0, NULL);
+    pthread_mutex_unlock(&g_fsLock);
     return 0;
 }
 
@@ -175,7 +536,14 @@ i32 fsSeek(i32 fd, i32 offset, i32 whence) {
 // Return the cursor position for the file open on File Descriptor 'fd'
 // ============================================================================
 i32 fsTell(i32 fd) {
-    return bfsTell(fd);
+    i32 prev = statsEnter(OPTELL);
+    pthread_mutex_lock(&g_fsLock);
+    statsFile(bfsFdToInum(fd));
+    i32 curs = bfsTell(fd);
+    statsLeave(prev);
+    traceOp(OPTELL, fd, 0, 0, curs, NULL);
+    pthread_mutex_unlock(&g_fsLock);
+    return curs;
 }
 
 
@@ -185,8 +553,36 @@ i32 fsTell(i32 fd) {
 // success, return the file size.  On failure, abort
 // ============================================================================
 i32 fsSize(i32 fd) {
+    i32 prev = statsEnter(OPSIZE);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsFdToInum(fd);
-    return bfsGetSize(inum);
+    statsFile(inum);
+    i32 size = bfsGetSize(inum);
+    statsLeave(prev);
+    traceOp(OPSIZE, fd, 0, 0, size, NULL);
+    pthread_mutex_unlock(&g_fsLock);
+    return size;
+}
+
+
+// ============================================================================
+// Fill 'top' with the I/O counters of up to 'max' files, busiest first: the
+// ones whose fs.h calls made the most bio calls.  Each file is counted from
+// its creation, or from when counting started or was reset, whichever came
+// later; a deleted file keeps its counts until its inum is reused.  Return
+// the number of files filled in
+// ============================================================================
+i32 fsTopFiles(FileStats* top, i32 max) {
+    return statsTopFiles(top, max);
+}
+
+
+// ============================================================================
+// Let fs.h calls run again, after fsLock
+// ============================================================================
+i32 fsUnlock() {
+    pthread_mutex_unlock(&g_fsLock);
+    return 0;
 }
 
 
@@ -198,7 +594,10 @@ i32 fsSize(i32 fd) {
 i32 fsWrite(i32 fd, i32 numb, void *buf) {
     if (numb <= 0) FATAL(ENEGNUMB);
 
+    i32 prev = statsEnter(OPWRITE);
+    pthread_mutex_lock(&g_fsLock);
     i32 inum = bfsFdToInum(fd);      // Convert file descriptor to inode number
+    statsFile(inum);
     i32 cursor = bfsTell(fd);        // Get current cursor position
     i32 size = bfsGetSize(inum);     // Get file size
 
@@ -213,6 +612,7 @@ i32 fsWrite(i32 fd, i32 numb, void *buf) {
             i32 gapStart = size;
             while (gapStart < cursor) {
                 i32 fbn = gapStart / BYTESPERBLOCK;
+                i32 off = gapStart % BYTESPERBLOCK;
                 i32 dbn = bfsFbnToDbn(inum, fbn);
 
                 // If this block has not been allocated yet, allocate it
@@ -220,9 +620,16 @@ i32 fsWrite(i32 fd, i32 numb, void *buf) {
                     dbn = bfsAllocBlock(inum, fbn);
                 }
 
+                // Keep the bytes before the old EOF in its last block
                 i8 zeroBlock[BYTESPERBLOCK] = {0};
+                PROFENTER(PROFFS, PROFDATA);
+                if (off != 0) {
+                    bioRead(dbn, zeroBlock);
+                    memset(zeroBlock + off, 0, BYTESPERBLOCK - off);
+                }
                 bioWrite(dbn, zeroBlock);
-                gapStart += BYTESPERBLOCK;  // Move to next block
+                PROFLEAVE();
+                gapStart += BYTESPERBLOCK - off;  // Move to next block
             }
         }
         bfsSetSize(inum, cursor + numb); // Update file size
@@ -246,7 +653,9 @@ i32 fsWrite(i32 fd, i32 numb, void *buf) {
         } else {
             // Read existing block if modifying only part of it
             if (offset != 0 || numb - bytesWritten < BYTESPERBLOCK) {
+                PROFENTER(PROFFS, PROFDATA);
                 bioRead(dbn, blockBuf);
+                PROFLEAVE();
             }
         }
 
@@ -257,10 +666,14 @@ i32 fsWrite(i32 fd, i32 numb, void *buf) {
         }
 
         // Copy data from input buffer to block buffer
+        PROFENTER(PROFFS, PROFCOPY);
         memcpy(blockBuf + offset, buf8 + bytesWritten, blockBytesToWrite);
+        PROFLEAVE();
 
         // Write block back to disk
+        PROFENTER(PROFFS, PROFDATA);
         bioWrite(dbn, blockBuf);
+        PROFLEAVE();
 
         bytesWritten += blockBytesToWrite;
         offset = 0;                  // Reset offset for next blocks
@@ -270,5 +683,9 @@ i32 fsWrite(i32 fd, i32 numb, void *buf) {
     // Update cursor position
     bfsSetCursor(inum, cursor + bytesWritten);
 
+    statsBytes(IOWRITE, bytesWritten);
+    statsLeave(prev);
+    traceOp(OPWRITE, fd, cursor, numb, 0, NULL);
+    pthread_mutex_unlock(&g_fsLock);
     return 0; // Success
 }
\ No newline at end of file
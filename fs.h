@@ -8,16 +8,49 @@
 #include <stdio.h>
 #include "alias.h"
 #include "errors.h"
+#include "stats.h"
+
+#define FSPLANSTEPS   512         // bio calls an FsPlan lists
+
+typedef struct {                  // FsStep: one bio call a request would make
+  i16 dbn;
+  u8  bc;                         // BCxxx role of the block
+  u8  rw;                         // IOREAD or IOWRITE
+  u8  hit;                        // 1 if the block cache would serve it
+  u8  pad;
+} FsStep;
+
+typedef struct {                  // FsPlan: see fsExplain
+  i32 op;                         // OPREAD or OPWRITE
+  i32 offset;                     // first byte requested
+  i32 len;                        // # bytes requested
+  i32 bytes;                      // # bytes it would move: reads stop at EOF
+  i32 size;                       // file size before
+  i32 newSize;                    // file size after
+  i32 metaIOs;                    // bio calls on any block but file data
+  i32 dataIOs;                    // bio calls on file data blocks
+  i32 hits;                       // bio calls the block cache would serve
+  i32 allocs;                     // blocks it would take from the Freelist
+  i32 full;                       // 1 if it would fail with EDISKFULL
+  i32 numSteps;                   // bio calls in all
+  FsStep steps[FSPLANSTEPS];      // the first FSPLANSTEPS, in order
+} FsPlan;
 
 i32 fsClose (i32 fd);
 i32 fsCreate(str name);
+i32 fsDelete(str fname);
+i32 fsExplain(i32 fd, i32 op, i32 offset, i32 len, FsPlan* plan);
 i32 fsFormat();
+i32 fsGetStats(FsStats* st);
+i32 fsLock();
 i32 fsMount();
 i32 fsOpen  (str fname);
 i32 fsRead  (i32 fd, i32 numb,   void* buf);
 i32 fsSeek  (i32 fd, i32 offset, i32   whence);
 i32 fsSize  (i32 fd);
 i32 fsTell  (i32 fd);
+i32 fsTopFiles(FileStats* top, i32 max);
+i32 fsUnlock();
 i32 fsWrite (i32 fd, i32 numb,   void* buf);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,270 @@
+// ============================================================================
+// fsck.c - parallel consistency checker for a BFS disk
+// ============================================================================
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "fsck.h"
+#include "hist.h"
+
+#define FSCKNONE      0                     // Owners: nobody
+#define FSCKFREE      (NUMINODES + 1)       //   the Freelist; else inum + 1
+#define FSCKMAXFBNS   (NUMDIRECT + I16SPERBLOCK)
+
+static i8          s_fsckImg[BLOCKSPERDISK][BYTESPERBLOCK];  // the disk
+static atomic_int  s_fsckOwner[BLOCKSPERDISK];  // reference map of blocks
+static atomic_int  g_fsckNext = 0;          // next job for a thread
+static FsckReport* g_fsckRep  = NULL;       // report being filled
+static i32         g_fsckMsgs = 0;          // problems described so far
+static pthread_mutex_t g_fsckLock = PTHREAD_MUTEX_INITIALIZER;  // report
+
+
+
+// ============================================================================
+// Record a problem: an error if 'err', else a warning.  Bump counter 'count'
+// of the report, if not NULL.  The first FSCKMAXMSGS are described
+// ============================================================================
+static void fsckProblem(i32 err, i32* count, str fmt, ...) {
+  pthread_mutex_lock(&g_fsckLock);
+  if (err) ++g_fsckRep->errors; else ++g_fsckRep->warnings;
+  if (count != NULL) ++*count;
+  if (g_fsckMsgs++ < FSCKMAXMSGS) {
+    va_list ap;
+    va_start(ap, fmt);
+    printf("FSCK : %s : ", err ? "BAD " : "WARN");
+    vprintf(fmt, ap);
+    printf(" \n");
+    va_end(ap);
+  }
+  pthread_mutex_unlock(&g_fsckLock);
+}
+
+
+
+// ============================================================================
+// Claim block 'dbn' for owner 'who' (FSCKFREE, or inum + 1), as 'what' (eg:
+// "FBN 7 of inum 2").  Report a DBN out of range, or a block some other map
+// claimed first.  Return 1 if the claim stands, else 0
+// ============================================================================
+static i32 fsckClaim(i32 dbn, i32 who, str what) {
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) {
+    fsckProblem(1, &g_fsckRep->range, "%s: DBN %d out of range", what, dbn);
+    return 0;
+  }
+  i32 none = FSCKNONE;
+  if (atomic_compare_exchange_strong(&s_fsckOwner[dbn], &none, who)) {
+    return 1;
+  }
+  if (none == FSCKFREE) {
+    fsckProblem(1, &g_fsckRep->doubles, "%s: DBN %d also on the Freelist",
+      what, dbn);
+  } else {
+    fsckProblem(1, &g_fsckRep->doubles, "%s: DBN %d also held by inum %d",
+      what, dbn, none - 1);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Check Inode 'inum' against Directory 'dir': every DBN its maps hold below
+// EOF is claimed for it.  Map entries past EOF are never used, so they are
+// only warned about
+// ============================================================================
+static void fsckInode(Dir* dir, i32 inum) {
+  Inode* ino   = &((Inode*)s_fsckImg[DBNINODES])[inum];
+  i32    named = dir->fname[inum][0] != 0;
+  i32    busy  = ino->size != 0 || ino->indirect != 0;
+  for (i32 f = 0; f < NUMDIRECT; ++f) busy |= ino->direct[f] != 0;
+
+  if (!named && !busy) return;
+  if (!named) {
+    fsckProblem(1, NULL, "inum %d: Inode in use, but no Directory entry",
+      inum);
+  }
+
+  i32 numFbns = (ino->size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+  if (ino->size < 0 || numFbns > FSCKMAXFBNS) {
+    fsckProblem(1, NULL, "inum %d: size %d out of range", inum, ino->size);
+    numFbns = (ino->size < 0) ? 0 : FSCKMAXFBNS;
+  }
+
+  char what[32];
+  for (i32 f = 0; f < NUMDIRECT; ++f) {
+    i32 dbn = ino->direct[f];
+    if (dbn == 0) continue;                     // a hole
+    if (f >= numFbns) {
+      fsckProblem(0, NULL, "inum %d: FBN %d past EOF maps DBN %d", inum, f,
+        dbn);
+      continue;
+    }
+    snprintf(what, sizeof(what), "FBN %d of inum %d", f, inum);
+    fsckClaim(dbn, inum + 1, what);
+  }
+
+  if (ino->indirect == 0) return;
+  snprintf(what, sizeof(what), "indirect of inum %d", inum);
+  if (!fsckClaim(ino->indirect, inum + 1, what)) return;
+
+  i16* ind = (i16*)s_fsckImg[ino->indirect];
+  for (i32 f = NUMDIRECT; f < FSCKMAXFBNS; ++f) {
+    i32 dbn = ind[f - NUMDIRECT];
+    if (dbn == 0) continue;
+    if (f >= numFbns) {
+      fsckProblem(0, NULL, "inum %d: FBN %d past EOF maps DBN %d", inum, f,
+        dbn);
+      continue;
+    }
+    snprintf(what, sizeof(what), "FBN %d of inum %d", f, inum);
+    fsckClaim(dbn, inum + 1, what);
+  }
+}
+
+
+
+// ============================================================================
+// Walk the Freelist from the SuperBlock, claiming each block on it.  A link
+// out of range, or back to a block already walked (a cycle), ends the walk;
+// a block a file also holds does not, so that one bad link does not make the
+// rest of the list look leaked.  Freed blocks are zeroed apart from their
+// link, so anything else in one is warned about
+// ============================================================================
+static void fsckFreeList() {
+  Super* super = (Super*)s_fsckImg[DBNSUPER];
+  u8     seen[BLOCKSPERDISK] = {0};         // walked already?
+  char   what[32];
+  i32    prev  = 0;
+
+  for (i32 dbn = super->firstFree; dbn != 0; ) {
+    if (prev == 0) snprintf(what, sizeof(what), "Freelist head");
+    else           snprintf(what, sizeof(what), "Freelist after %d", prev);
+    if (dbn >= MINDBN && dbn < BLOCKSPERDISK && seen[dbn]) {
+      fsckProblem(1, &g_fsckRep->cycles, "%s: DBN %d again, a cycle", what,
+        dbn);
+      return;
+    }
+    if (!fsckClaim(dbn, FSCKFREE, what)) {
+      if (dbn < MINDBN || dbn >= BLOCKSPERDISK) return;
+    }
+    seen[dbn] = 1;
+
+    i16* link = (i16*)s_fsckImg[dbn];
+    for (i32 w = 1; w < I16SPERBLOCK; ++w) {
+      if (link[w] == 0) continue;
+      fsckProblem(0, NULL, "free DBN %d is not zeroed", dbn);
+      break;
+    }
+    prev = dbn;
+    dbn  = link[0];
+  }
+}
+
+
+
+// ============================================================================
+// Body of each checking thread: take jobs until there are none left.  Jobs
+// 0 to NUMINODES - 1 check that Inode; job NUMINODES walks the Freelist
+// ============================================================================
+static void* fsckThread(void* p) {
+  Dir* dir = (Dir*)p;
+  for (;;) {
+    i32 job = atomic_fetch_add(&g_fsckNext, 1);
+    if (job > NUMINODES) break;
+    if (job == NUMINODES) fsckFreeList(); else fsckInode(dir, job);
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Check the SuperBlock and the Directory, which the threads rely on
+// ============================================================================
+static void fsckMeta(Dir* dir) {
+  Super* super = (Super*)s_fsckImg[DBNSUPER];
+  if (super->numBlocks != BLOCKSPERDISK) {
+    fsckProblem(1, NULL, "SuperBlock: numBlocks %d, should be %d",
+      super->numBlocks, BLOCKSPERDISK);
+  }
+  if (super->numInodes != NUMINODES) {
+    fsckProblem(1, NULL, "SuperBlock: numInodes %d, should be %d",
+      super->numInodes, NUMINODES);
+  }
+  for (i32 b = sizeof(Super); b < BYTESPERBLOCK; ++b) {
+    if (s_fsckImg[DBNSUPER][b] == 0) continue;
+    fsckProblem(0, NULL, "SuperBlock: byte %d is not zero", b);
+    break;
+  }
+
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    str name = dir->fname[inum];
+    if (memchr(name, 0, FNAMESIZE) == NULL) {
+      fsckProblem(1, NULL, "Directory: name of inum %d not terminated", inum);
+      name[FNAMESIZE - 1] = 0;
+    }
+    if (name[0] == 0) continue;
+    ++g_fsckRep->files;
+    for (i32 other = 0; other < inum; ++other) {
+      if (strcmp(name, dir->fname[other]) != 0) continue;
+      fsckProblem(0, NULL, "Directory: inums %d and %d both named %s", other,
+        inum, name);
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Check the BFS disk in use, with 'threads' threads (FSCKTHREADS if 0 or
+// less), and fill 'rep' with what was found; each problem is also printed,
+// up to FSCKMAXMSGS.  Return the number of errors: 0 if the disk is
+// consistent
+// ============================================================================
+i32 fsckRun(i32 threads, FsckReport* rep) {
+  if (rep == NULL) FATAL(ENULLPTR);
+  if (threads <= 0)             threads = FSCKTHREADS;
+  if (threads > FSCKMAXTHREADS) threads = FSCKMAXTHREADS;
+
+  memset(rep, 0, sizeof(FsckReport));
+  g_fsckRep  = rep;
+  g_fsckMsgs = 0;
+  u64 t0 = histNow();
+
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) {
+    bioPeek(dbn, s_fsckImg[dbn]);
+    atomic_store(&s_fsckOwner[dbn], FSCKNONE);
+  }
+
+  Dir dir;
+  memcpy(&dir, s_fsckImg[DBNDIR], sizeof(Dir));
+  fsckMeta(&dir);
+
+  pthread_t tid[FSCKMAXTHREADS];
+  atomic_store(&g_fsckNext, 0);
+  for (i32 t = 0; t < threads; ++t) {
+    pthread_create(&tid[t], NULL, fsckThread, &dir);
+  }
+  for (i32 t = 0; t < threads; ++t) pthread_join(tid[t], NULL);
+
+  for (i32 dbn = MINDBN; dbn < BLOCKSPERDISK; ++dbn) {
+    i32 who = atomic_load(&s_fsckOwner[dbn]);
+    if (who == FSCKFREE)      ++rep->free;
+    else if (who != FSCKNONE) ++rep->used;
+    else fsckProblem(1, &rep->leaked, "DBN %d leaked: neither in a file nor "
+                     "free", dbn);
+  }
+
+  rep->ns = histNow() - t0;
+  printf("FSCK : %s : %d files, %d blocks used, %d free, %d leaked; %d "
+    "errors, %d warnings; %.1f us, %d threads \n", rep->errors ? "BAD " :
+    "GOOD", rep->files, rep->used, rep->free, rep->leaked, rep->errors,
+    rep->warnings, rep->ns / 1e3, threads);
+  fflush(stdout);
+
+  g_fsckRep = NULL;
+  return rep->errors;
+}
@@ -0,0 +1,40 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+// ===================================================================
+// fsck.h - consistency checker for a BFS disk.  It checks the
+// SuperBlock, the Directory, every Inode's direct and indirect maps,
+// and the Freelist, and cross-checks them all through one reference
+// map of who owns each block: a block claimed twice, a DBN out of
+// range, a block that is neither in a file nor on the Freelist
+// (leaked), and a Freelist that cycles are all errors.  Inodes are
+// checked by a pool of threads, which claim blocks in that map with
+// compare-and-swap, while one of them walks the Freelist.
+//
+// The disk is read whole, through the block cache, before checking
+// starts, so it should not change meanwhile: run it unmounted, or with
+// nothing writing
+// ===================================================================
+
+#include "alias.h"
+
+#define FSCKTHREADS   4           // default # checking threads
+#define FSCKMAXTHREADS 16
+#define FSCKMAXMSGS   20          // problems described; the rest counted
+
+typedef struct {          // FsckReport
+  i32 errors;             // problems: the disk is inconsistent
+  i32 warnings;           // oddities that lose nothing
+  i32 files;              // files in the Directory
+  i32 used;               // blocks held by files, indirect blocks included
+  i32 free;               // blocks on the Freelist
+  i32 leaked;             // blocks neither held by a file nor free
+  i32 doubles;            // blocks claimed more than once
+  i32 range;              // DBNs out of range, in maps or the Freelist
+  i32 cycles;             // Freelist links back to a block already on it
+  u64 ns;                 // time taken, the disk read included
+} FsckReport;
+
+i32 fsckRun(i32 threads, FsckReport* rep);
+
+#endif
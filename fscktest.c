@@ -0,0 +1,212 @@
+// ============================================================================
+// fscktest.c : check that fsck finds damage done on purpose to a scratch
+// disk, and counts it right, and that the offline defragmenter, which relies
+// on fsck, leaves such a disk alone
+// ============================================================================
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bfs.h"
+#include "defrag.h"
+#include "fs.h"
+#include "fsck.h"
+#include "fscktest.h"
+
+static i32 g_fsckFailures = 0;
+static i8  s_fsckBefore[BLOCKSPERDISK][BYTESPERBLOCK];
+static i8  s_fsckAfter [BLOCKSPERDISK][BYTESPERBLOCK];
+
+
+
+// ============================================================================
+// Check that 'actual' is 'expected'.  'testnum' is the test number - used
+// for reporting
+// ============================================================================
+static void fsckTestCheck(i32 testnum, str what, i32 actual, i32 expected) {
+  if (actual == expected) {
+    printf("FSCKTEST %d : GOOD : %-24s %3d \n", testnum, what, actual);
+    return;
+  }
+  printf("FSCKTEST %d : BAD  : %-24s %3d but should be %d \n", testnum, what,
+    actual, expected);
+  ++g_fsckFailures;
+}
+
+
+
+// ============================================================================
+// Format FSCKTESTDISK afresh and write files "A" and "B" of 3 blocks, and
+// "C" of 7, which needs an indirect block.  Return their inums in 'inum'
+// ============================================================================
+static void fsckTestDisk(i32 inum[3]) {
+  fsFormat();
+  fsMount();
+
+  i8  buf[BYTESPERBLOCK];
+  str names[3]  = { "A", "B", "C" };
+  i32 blocks[3] = { 3, 3, 7 };
+  for (i32 f = 0; f < 3; ++f) {
+    memset(buf, 'A' + f, BYTESPERBLOCK);
+    i32 fd = fsCreate(names[f]);
+    for (i32 b = 0; b < blocks[f]; ++b) fsWrite(fd, BYTESPERBLOCK, buf);
+    fsClose(fd);
+    inum[f] = bfsLookupFile(names[f]);
+    bfsDerefOFT(inum[f]);
+  }
+}
+
+
+
+// ============================================================================
+// Set i16 word 'word' of block 'dbn' to 'val'
+// ============================================================================
+static void fsckTestPoke(i32 dbn, i32 word, i32 val) {
+  i16 buf[I16SPERBLOCK];
+  bioPeek(dbn, buf);
+  buf[word] = val;
+  bioWrite(dbn, buf);
+}
+
+
+
+// ============================================================================
+// Return i16 word 'word' of block 'dbn'
+// ============================================================================
+static i32 fsckTestPeek(i32 dbn, i32 word) {
+  i16 buf[I16SPERBLOCK];
+  bioPeek(dbn, buf);
+  return buf[word];
+}
+
+
+
+// ============================================================================
+// Point the SuperBlock's Freelist head at 'dbn'
+// ============================================================================
+static void fsckTestSetFree(i32 dbn) {
+  i8 buf[BYTESPERBLOCK];
+  bioPeek(DBNSUPER, buf);
+  ((Super*)buf)->firstFree = dbn;
+  bioWrite(DBNSUPER, buf);
+}
+
+
+
+// ============================================================================
+// Return the head of the Freelist
+// ============================================================================
+static i32 fsckTestGetFree() {
+  i8 buf[BYTESPERBLOCK];
+  bioPeek(DBNSUPER, buf);
+  return ((Super*)buf)->firstFree;
+}
+
+
+
+// ============================================================================
+// Run every fsck test against FSCKTESTDISK, then restore the previous disk.
+// Return the number of failed checks
+// ============================================================================
+i32 fscktest() {
+  str oldDisk = bioDisk();
+  bioSetDisk(FSCKTESTDISK);
+  g_fsckFailures = 0;
+
+  i32 inum[3];
+  Inode ino;
+  FsckReport rep;
+
+  // TEST 1 : a disk just written is consistent
+
+  fsckTestDisk(inum);
+  fsckRun(0, &rep);
+  i32 numFree = rep.free;
+  fsckTestCheck(1, "clean: errors", rep.errors, 0);
+  fsckTestCheck(1, "clean: files",  rep.files,  3);
+  fsckTestCheck(1, "clean: used",   rep.used,   14);
+  fsckTestCheck(1, "clean: free",   rep.free,   BLOCKSPERDISK - MINDBN - 14);
+
+  // TEST 2 : B's first block is also A's: double-allocated, and B's own
+  // block leaked
+
+  fsckTestDisk(inum);
+  bfsReadInode(inum[0], &ino);
+  i32 dbnA = ino.direct[0];
+  bfsReadInode(inum[1], &ino);
+  ino.direct[0] = dbnA;
+  bfsWriteInode(inum[1], &ino);
+  fsckRun(0, &rep);
+  fsckTestCheck(2, "double: doubles", rep.doubles, 1);
+  fsckTestCheck(2, "double: leaked",  rep.leaked,  1);
+  fsckTestCheck(2, "double: errors",  rep.errors,  2);
+
+  // TEST 3 : the Freelist head is dropped from the list: leaked
+
+  fsckTestDisk(inum);
+  i32 head = fsckTestGetFree();
+  fsckTestSetFree(fsckTestPeek(head, 0));
+  fsckRun(0, &rep);
+  fsckTestCheck(3, "leak: leaked", rep.leaked, 1);
+  fsckTestCheck(3, "leak: free",   rep.free,   numFree - 1);
+  fsckTestCheck(3, "leak: errors", rep.errors, 1);
+
+  // TEST 4 : A's second block maps a DBN off the disk; the real one leaks
+
+  fsckTestDisk(inum);
+  bfsReadInode(inum[0], &ino);
+  ino.direct[1] = BLOCKSPERDISK + 50;
+  bfsWriteInode(inum[0], &ino);
+  fsckRun(0, &rep);
+  fsckTestCheck(4, "range: range",  rep.range,  1);
+  fsckTestCheck(4, "range: leaked", rep.leaked, 1);
+  fsckTestCheck(4, "range: errors", rep.errors, 2);
+
+  // TEST 5 : the Freelist runs into A's second block, which links to
+  // itself.  The walk must end, reporting the cycle
+
+  fsckTestDisk(inum);
+  bfsReadInode(inum[0], &ino);
+  fsckTestSetFree(ino.direct[1]);
+  fsckTestPoke(ino.direct[1], 0, ino.direct[1]);
+  fsckRun(0, &rep);
+  fsckTestCheck(5, "file cycle: cycles",  rep.cycles,  1);
+  fsckTestCheck(5, "file cycle: doubles", rep.doubles, 1);
+  fsckTestCheck(5, "file cycle: leaked",  rep.leaked,  numFree);
+
+  // TEST 6 : the second free block links back to the first
+
+  fsckTestDisk(inum);
+  head = fsckTestGetFree();
+  fsckTestPoke(fsckTestPeek(head, 0), 0, head);
+  fsckRun(0, &rep);
+  fsckTestCheck(6, "free cycle: cycles", rep.cycles, 1);
+  fsckTestCheck(6, "free cycle: free",   rep.free,   2);
+  fsckTestCheck(6, "free cycle: leaked", rep.leaked, numFree - 2);
+
+  // TEST 7 : offline defrag refuses a disk that fails fsck - here, one
+  // whose Freelist cycles - and does not touch it
+
+  fsckTestDisk(inum);
+  bfsReadInode(inum[0], &ino);
+  fsckTestSetFree(ino.direct[1]);
+  fsckTestPoke(ino.direct[1], 0, ino.direct[1]);
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) {
+    bioPeek(dbn, s_fsckBefore[dbn]);
+  }
+  DefragReport defrag;
+  i32 ret = defragOffline(&defrag);
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) {
+    bioPeek(dbn, s_fsckAfter[dbn]);
+  }
+  fsckTestCheck(7, "defrag: refused", ret == EBADDISK, 1);
+  fsckTestCheck(7, "defrag: disk untouched",
+    memcmp(s_fsckBefore, s_fsckAfter, sizeof(s_fsckAfter)) == 0, 1);
+  fsckTestCheck(7, "defrag: blocks moved", defrag.blocks, 0);
+
+  bioClose();
+  remove(FSCKTESTDISK);
+  bioSetDisk(oldDisk);
+
+  return g_fsckFailures;
+}
@@ -0,0 +1,17 @@
+#ifndef FSCKTEST_H
+#define FSCKTEST_H
+
+// ===================================================================
+// fscktest.h - consistency checker tests.  Each test builds a small
+// scratch disk, damages it in one known way, and checks that fsck
+// counts exactly that damage, or that the offline defragmenter turns
+// the damaged disk away
+// ===================================================================
+
+#include "alias.h"
+
+#define FSCKTESTDISK  "FSCKTESTDISK"
+
+i32 fscktest();
+
+#endif
@@ -0,0 +1,174 @@
+// ============================================================================
+// gen.c - synthetic BFS images, built in memory and written in bulk
+// ============================================================================
+
+#include "bfs.h"
+#include "gen.h"
+#include "hist.h"
+
+static u32 g_genRand = 1;               // xorshift32 state; never 0
+
+
+
+// ============================================================================
+// Return the floor of log2 of 'n'; 0 for 0
+// ============================================================================
+static i32 genLog2(u32 n) {
+  i32 b = 0;
+  while (n >>= 1) ++b;
+  return b;
+}
+
+
+
+// ============================================================================
+// Pick a free block, and mark it used.  With probability 'frag'%, pick any
+// free block at random; otherwise the first free block at or after '*next',
+// so that the file grows in place.  Return its DBN
+// ============================================================================
+static i32 genAlloc(u8 used[BLOCKSPERDISK], i32* numFree, i32* next,
+                    i32 frag) {
+  i32 dbn = -1;
+  if (frag > 0 && (i32)(xorshift(&g_genRand) % 100) < frag) {
+    i32 k = xorshift(&g_genRand) % *numFree;     // the k'th free block
+    for (dbn = MINDBN; used[dbn] || k-- > 0; ++dbn) { }
+  } else {
+    dbn = (*next >= MINDBN && *next < BLOCKSPERDISK) ? *next : MINDBN;
+    while (used[dbn]) dbn = (dbn + 1 < BLOCKSPERDISK) ? dbn + 1 : MINDBN;
+  }
+  used[dbn] = 1;
+  --*numFree;
+  *next = dbn + 1;
+  return dbn;
+}
+
+
+
+// ============================================================================
+// Fill 'buf' with the contents of FBN 'fbn' of file 'inum', in the image
+// that 'spec' describes.  Bytes beyond EOF in the last block read as zero
+// in the image, but are filled here like the rest of the block
+// ============================================================================
+i32 genBlock(GenSpec* spec, i32 inum, i32 fbn, void* buf) {
+  if (spec == NULL || buf == NULL) FATAL(ENULLPTR);
+
+  if (spec->pattern == GENFBN) {
+    memset(buf, (i8)fbn, BYTESPERBLOCK);
+  } else if (spec->pattern == GENRANDOM) {
+    u32 state = spec->seed ^ (u32)(inum + 1) * 0x9E3779B1u
+                           ^ (u32)(fbn  + 1) * 0x85EBCA77u;
+    if (state == 0) state = 1;
+    u32* p = (u32*)buf;
+    for (i32 i = 0; i < BYTESPERBLOCK / 4; ++i) p[i] = xorshift(&state);
+  } else {
+    memset(buf, 0, BYTESPERBLOCK);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return a file size, in bytes, drawn from the distribution in 'spec'.  For
+// GENLOG, first pick a power of two at random, then a size within it
+// ============================================================================
+static i32 genSize(GenSpec* spec) {
+  i32 lo = spec->minSize;
+  i32 hi = spec->maxSize;
+  if (spec->dist == GENLOG) {
+    i32 bLo = genLog2(lo + 1);
+    i32 bHi = genLog2(hi + 1);
+    i32 b   = bLo + xorshift(&g_genRand) % (bHi - bLo + 1);
+    if ((1 << b) - 1 > lo) lo = (1 << b) - 1;
+    if ((2 << b) - 2 < hi) hi = (2 << b) - 2;
+  }
+  return lo + xorshift(&g_genRand) % (hi - lo + 1);
+}
+
+
+
+// ============================================================================
+// Build the image that 'spec' describes and write it, whole, into 'path'.
+// Files are laid out in inum order.  Each takes a size from the spec, cut
+// down if the disk has no room left for it; its blocks follow one another
+// except where 'frag' scatters them.  The blocks left over form the
+// Freelist, in DBN order.  Out-of-range fields of the spec are clamped.
+// Whatever bio holds open is closed first: mount the disk afresh after.
+// Return the number of blocks the files use
+// ============================================================================
+i32 genImage(str path, GenSpec* spec) {
+  if (path == NULL || spec == NULL) FATAL(ENULLPTR);
+
+  GenSpec s = *spec;
+  i32 maxSize = MAXFBN * BYTESPERBLOCK;
+  if (s.files   < 0)         s.files   = 0;
+  if (s.files   > NUMINODES) s.files   = NUMINODES;
+  if (s.minSize < 0)         s.minSize = 0;
+  if (s.maxSize > maxSize)   s.maxSize = maxSize;
+  if (s.minSize > s.maxSize) s.minSize = s.maxSize;
+  if (s.frag    < 0)         s.frag    = 0;
+  if (s.frag    > 100)       s.frag    = 100;
+  g_genRand = s.seed ? s.seed : 1;
+
+  i8* img = calloc(BLOCKSPERDISK, BYTESPERBLOCK);
+  if (img == NULL) FATAL(ENOMEM);
+  Super* super  = (Super*)(img + DBNSUPER  * BYTESPERBLOCK);
+  Inode* inodes = (Inode*)(img + DBNINODES * BYTESPERBLOCK);
+  Dir*   dir    = (Dir*)  (img + DBNDIR    * BYTESPERBLOCK);
+
+  super->numBlocks = BLOCKSPERDISK;
+  super->numInodes = NUMINODES;
+
+  u8  used[BLOCKSPERDISK] = {0};
+  i32 numFree = BLOCKSPERDISK - NUMMETA;
+  i32 next    = MINDBN;
+  for (i32 dbn = 0; dbn < MINDBN; ++dbn) used[dbn] = 1;
+
+  for (i32 inum = 0; inum < s.files; ++inum) {
+    i32 size = genSize(&s);
+    i32 fbns = (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+    i32 room = (numFree > NUMDIRECT) ? numFree - 1 : numFree;  // indirect
+    if (fbns > room) {
+      fbns = room;
+      size = fbns * BYTESPERBLOCK;
+    }
+
+    sprintf(dir->fname[inum], "F%d", inum);
+    Inode* inode = &inodes[inum];
+    inode->size  = size;
+
+    i16* ind = NULL;
+    for (i32 fbn = 0; fbn < fbns; ++fbn) {
+      if (fbn == NUMDIRECT) {
+        inode->indirect = genAlloc(used, &numFree, &next, s.frag);
+        ind = (i16*)(img + inode->indirect * BYTESPERBLOCK);
+      }
+      i32 dbn = genAlloc(used, &numFree, &next, s.frag);
+      if (fbn < NUMDIRECT) inode->direct[fbn]   = dbn;
+      else                 ind[fbn - NUMDIRECT] = dbn;
+
+      i8* blk = img + dbn * BYTESPERBLOCK;
+      genBlock(&s, inum, fbn, blk);
+      i32 tail = (fbn + 1) * BYTESPERBLOCK - size;  // past EOF
+      if (tail > 0) memset(blk + BYTESPERBLOCK - tail, 0, tail);
+    }
+  }
+
+  i16 link = 0;                                 // Freelist, back to front
+  for (i32 dbn = BLOCKSPERDISK - 1; dbn >= MINDBN; --dbn) {
+    if (used[dbn]) continue;
+    ((i16*)(img + dbn * BYTESPERBLOCK))[0] = link;
+    link = dbn;
+  }
+  super->firstFree = link;
+
+  bioClose();
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) FATAL(EDISKCREATE);
+  size_t n = fwrite(img, BYTESPERBLOCK, BLOCKSPERDISK, fp);
+  fclose(fp);
+  free(img);
+  if (n != BLOCKSPERDISK) FATAL(EBADWRITE);
+
+  return BLOCKSPERDISK - NUMMETA - numFree;
+}
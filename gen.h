@@ -0,0 +1,35 @@
+#ifndef GEN_H
+#define GEN_H
+
+// ===================================================================
+// gen.h - synthetic BFS images.  genImage builds a populated disk
+// straight from a GenSpec - how many files, how big, how scattered,
+// filled with what - in memory, and writes it out in one go, rather
+// than through fs.h one block at a time.  The same spec and seed
+// always build the same image; genBlock returns what any block of it
+// should hold, to check reads against
+// ===================================================================
+
+#include "alias.h"
+
+#define GENUNIFORM    0           // Sizes: uniform in [minSize, maxSize]
+#define GENLOG        1           //   log-uniform: as many small as large
+
+#define GENZERO       0           // Contents: all zeroes
+#define GENFBN        1           //   every byte of FBN 'b' is 'b'
+#define GENRANDOM     2           //   pseudo-random, from seed, inum, FBN
+
+typedef struct {          // GenSpec: what genImage builds
+  i32 files;              // # files, named F0, F1... up to NUMINODES
+  i32 minSize;            // bytes in the smallest file
+  i32 maxSize;            // bytes in the largest file
+  i32 dist;               // GENUNIFORM or GENLOG
+  i32 frag;               // % of blocks placed at random, 0 to 100
+  i32 pattern;            // GENZERO, GENFBN or GENRANDOM
+  u32 seed;
+} GenSpec;
+
+i32 genBlock(GenSpec* spec, i32 inum, i32 fbn, void* buf);
+i32 genImage(str path, GenSpec* spec);
+
+#endif
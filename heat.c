@@ -0,0 +1,220 @@
+// ============================================================================
+// heat.c - per-block access heat map: export, and render against the layout
+// ============================================================================
+
+#include "bfs.h"
+#include "heat.h"
+#include "stats.h"
+
+static char g_heatClass[NUMBC + 1] = "SIDXdf";   // map letter per BCxxx
+static char g_heatLevel[]          = " .:-=+*#%@";
+
+
+
+// ============================================================================
+// Work out the role every block plays in the volume now: metadata, indirect
+// or data block of some file, or on the Freelist.  Blocks in none of these
+// are HEATLOST
+// ============================================================================
+static void heatLayout(u8 bc[BLOCKSPERDISK]) {
+  memset(bc, HEATLOST, BLOCKSPERDISK);
+  bc[DBNSUPER]  = BCSUPER;
+  bc[DBNINODES] = BCINODE;
+  bc[DBNDIR]    = BCDIR;
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioRead(DBNDIR, buf);
+  Dir* dir = (Dir*)buf;
+
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    if (dir->fname[inum][0] == '\0') continue;
+
+    Inode inode;
+    bfsReadInode(inum, &inode);
+
+    i16 ind[I16SPERBLOCK] = {0};
+    if (inode.indirect >= MINDBN && inode.indirect < BLOCKSPERDISK) {
+      bc[inode.indirect] = BCINDIRECT;
+      statsClass(BCINDIRECT);
+      bioRead(inode.indirect, ind);
+    }
+
+    i32 numFbns = (inode.size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+    for (i32 fbn = 0; fbn < numFbns && fbn < MAXFBN; ++fbn) {
+      i32 dbn = (fbn < NUMDIRECT) ? inode.direct[fbn] : ind[fbn - NUMDIRECT];
+      if (dbn >= MINDBN && dbn < BLOCKSPERDISK) bc[dbn] = BCDATA;
+    }
+  }
+
+  bioRead(DBNSUPER, buf);
+  i32 dbn = ((Super*)buf)->firstFree;
+  while (dbn >= MINDBN && dbn < BLOCKSPERDISK && bc[dbn] != BCFREE) {
+    i16 buf16[I16SPERBLOCK] = {0};
+    statsClass(BCFREE);
+    bioRead(dbn, buf16);
+    bc[dbn] = BCFREE;
+    dbn = buf16[0];
+  }
+}
+
+
+
+// ============================================================================
+// Return the floor of log2 of 'n'; 0 for 0
+// ============================================================================
+static i32 heatLog2(u64 n) {
+  i32 b = 0;
+  while (n >>= 1) ++b;
+  return b;
+}
+
+
+
+// ============================================================================
+// Draw the heat map in file 'path', written by heatWrite.  Each DBN shows as
+// a letter for its role (S super, I inodes, D directory, X indirect, d data,
+// f free, ? lost) and a mark for its bio calls, on a log scale up to the
+// hottest block.  Then total the I/O by role, and list the hottest blocks
+// ============================================================================
+i32 heatRender(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) FATAL(ENODISK);
+
+  HeatHeader hdr;
+  if (fread(&hdr, sizeof(HeatHeader), 1, fp) != 1 ||
+      hdr.magic != HEATMAGIC || hdr.version != HEATVERSION) {
+    fclose(fp);
+    FATAL(EBADREAD);
+  }
+
+  i32 num = hdr.numBlocks;
+  HeatCell* cell = calloc(num, sizeof(HeatCell));
+  if (cell == NULL) FATAL(ENOMEM);
+  if (fread(cell, sizeof(HeatCell), num, fp) != (size_t)num) {
+    fclose(fp);
+    FATAL(EBADREAD);
+  }
+  fclose(fp);
+
+  u64 total = 0;
+  u64 max   = 0;
+  u64 reads = 0;
+  for (i32 d = 0; d < num; ++d) {
+    u64 n = (u64)cell[d].reads + cell[d].writes;
+    total += n;
+    reads += cell[d].reads;
+    if (n > max) max = n;
+  }
+
+  printf("\n%s: %d blocks, %llu reads, %llu writes \n", path, num,
+    (unsigned long long)reads, (unsigned long long)(total - reads));
+
+  i32 width = (num <= 200) ? 10 : 32;
+  i32 top   = heatLog2(max);
+  printf("\n%6s", "dbn");
+  for (i32 c = 0; c < width; ++c) printf(" +%-2d", c);
+  printf("\n");
+  for (i32 d = 0; d < num; ++d) {
+    if (d % width == 0) printf("%6d", d);
+    u64 n = (u64)cell[d].reads + cell[d].writes;
+    i32 level = (n == 0) ? 0
+              : 1 + (top == 0 ? 8 : 8 * heatLog2(n) / top);
+    char role = (cell[d].bc < NUMBC) ? g_heatClass[cell[d].bc] : '?';
+    printf("  %c%c", role, g_heatLevel[level]);
+    if (d % width == width - 1 || d == num - 1) printf("\n");
+  }
+  printf("(S super, I inodes, D dir, X indirect, d data, f free, ? lost) \n");
+  printf("(blank idle, then %s up to %llu calls, log scale) \n",
+    g_heatLevel + 1, (unsigned long long)max);
+
+  printf("\n%-9s %6s %10s %10s %7s \n", "role", "blocks", "reads", "writes",
+    "share");
+  for (i32 bc = 0; bc <= NUMBC; ++bc) {
+    i32 want   = (bc == NUMBC) ? HEATLOST : bc;
+    i32 blocks = 0;
+    u64 r = 0;
+    u64 w = 0;
+    for (i32 d = 0; d < num; ++d) {
+      if (cell[d].bc != want) continue;
+      ++blocks;
+      r += cell[d].reads;
+      w += cell[d].writes;
+    }
+    if (blocks == 0) continue;
+    printf("%-9s %6d %10llu %10llu %6.1f%% \n",
+      (bc == NUMBC) ? "lost" : statsClassName(bc), blocks,
+      (unsigned long long)r, (unsigned long long)w,
+      total ? 100.0 * (r + w) / total : 0.0);
+  }
+
+  u64 meta = 0;                                 // DBNs 0..2
+  for (i32 d = 0; d < MINDBN && d < num; ++d) {
+    meta += (u64)cell[d].reads + cell[d].writes;
+  }
+  printf("\nDBN 0-%d take %.1f%% of all bio calls \n", MINDBN - 1,
+    total ? 100.0 * meta / total : 0.0);
+
+  printf("hottest: ");                          // repeated selection; the
+  i32 shown = 0;                                // volume is small
+  u64 hot   = 0;
+  u8* seen  = calloc(num, 1);
+  if (seen == NULL) FATAL(ENOMEM);
+  while (shown < 10 && shown < num) {
+    i32 best = -1;
+    for (i32 d = 0; d < num; ++d) {
+      if (seen[d]) continue;
+      u64 n = (u64)cell[d].reads + cell[d].writes;
+      if (best < 0 || n > (u64)cell[best].reads + cell[best].writes) best = d;
+    }
+    u64 n = (u64)cell[best].reads + cell[best].writes;
+    if (n == 0) break;
+    seen[best] = 1;
+    hot += n;
+    printf("%d(%llu) ", best, (unsigned long long)n);
+    ++shown;
+  }
+  printf("\nthe %d hottest blocks take %.1f%% of all bio calls \n\n", shown,
+    total ? 100.0 * hot / total : 0.0);
+  fflush(stdout);
+
+  free(seen);
+  free(cell);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Save the bio calls counted on every DBN so far, with the current role of
+// each block, into heat map file 'path'
+// ============================================================================
+i32 heatWrite(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  u64 reads [BLOCKSPERDISK];
+  u64 writes[BLOCKSPERDISK];
+  statsGetHeat(reads, writes, BLOCKSPERDISK);   // before heatLayout reads
+
+  u8 bc[BLOCKSPERDISK];
+  heatLayout(bc);
+
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) FATAL(EDISKCREATE);
+
+  HeatHeader hdr = { HEATMAGIC, HEATVERSION, BLOCKSPERDISK, 0 };
+  fwrite(&hdr, sizeof(HeatHeader), 1, fp);
+
+  for (i32 d = 0; d < BLOCKSPERDISK; ++d) {
+    HeatCell c;
+    memset(&c, 0, sizeof(HeatCell));
+    c.reads  = (reads [d] > UINT32_MAX) ? UINT32_MAX : (u32)reads [d];
+    c.writes = (writes[d] > UINT32_MAX) ? UINT32_MAX : (u32)writes[d];
+    c.bc     = bc[d];
+    fwrite(&c, sizeof(HeatCell), 1, fp);
+  }
+
+  fclose(fp);
+  return 0;
+}
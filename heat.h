@@ -0,0 +1,35 @@
+#ifndef HEAT_H
+#define HEAT_H
+
+// ===================================================================
+// heat.h - per-block access heat map.  heatWrite saves the bio calls
+// counted on every DBN (see statsGetHeat), with the role each block
+// plays in the volume at that moment.  heatRender draws the map, DBN
+// by DBN, marked with the layout, and reports how concentrated the
+// I/O is
+// ===================================================================
+
+#include "alias.h"
+
+#define HEATMAGIC     0x54414548  // "HEAT"
+#define HEATVERSION   1
+#define HEATLOST      0xFF        // class of a block no one owns
+
+typedef struct {          // HeatHeader
+  u32 magic;              // HEATMAGIC
+  u32 version;            // HEATVERSION
+  u32 numBlocks;          // # DBNs that follow
+  u32 pad;
+} HeatHeader;
+
+typedef struct {          // HeatCell: one per DBN, after the header
+  u32 reads;              // bio reads, saturating
+  u32 writes;             // bio writes, saturating
+  u8  bc;                 // BCxxx role of the block, or HEATLOST
+  u8  pad[3];
+} HeatCell;
+
+i32 heatRender(str path);
+i32 heatWrite (str path);
+
+#endif
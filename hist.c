@@ -0,0 +1,165 @@
+// ============================================================================
+// hist.c - HDR-style latency histograms
+// ============================================================================
+
+#include <time.h>
+
+#include "hist.h"
+
+// A histogram has one writer, but may be merged into another by a reader
+// while it records: both sides use relaxed atomics, which cost no more than
+// a plain load and store
+#define HISTSET(f, v) __atomic_store_n(&(f), (v), __ATOMIC_RELAXED)
+#define HISTGET(f)    __atomic_load_n(&(f), __ATOMIC_RELAXED)
+
+// ============================================================================
+// Return the bin that holds value 'v'.  Values below HISTSUB get a bin each;
+// above that, bin = octave * HISTSUB + the top HISTSUBBITS bits below the
+// leading one
+// ============================================================================
+static i32 histBin(u64 v) {
+  if (v < HISTSUB) return (i32)v;
+
+  i32 e = 63 - __builtin_clzll(v);        // position of leading one
+  if (e >= HISTMAXBITS) return NUMHISTBINS - 1;
+
+  i32 sub = (i32)((v >> (e - HISTSUBBITS)) & (HISTSUB - 1));
+  return HISTSUB + (e - HISTSUBBITS) * HISTSUB + sub;
+}
+
+
+
+// ============================================================================
+// Return the representative (midpoint) value of bin 'bin'
+// ============================================================================
+u64 histBinValue(i32 bin) {
+  if (bin < HISTSUB) return (u64)bin;
+
+  i32 e   = (bin - HISTSUB) / HISTSUB + HISTSUBBITS;
+  i32 sub = (bin - HISTSUB) % HISTSUB;
+  u64 lo  = ((u64)(HISTSUB + sub)) << (e - HISTSUBBITS);
+  u64 w   = 1ULL << (e - HISTSUBBITS);
+  return lo + w / 2;
+}
+
+
+
+// ============================================================================
+// Add every value recorded in 'src' into 'dst'
+// ============================================================================
+i32 histMerge(Hist* dst, Hist* src) {
+  u64 count = HISTGET(src->count);
+  if (count == 0) return 0;
+
+  u64 min = HISTGET(src->min);
+  u64 max = HISTGET(src->max);
+  if (dst->count == 0 || min < dst->min) dst->min = min;
+  if (max > dst->max) dst->max = max;
+  dst->count += count;
+  dst->sum   += HISTGET(src->sum);
+  for (i32 b = 0; b < NUMHISTBINS; ++b) dst->bins[b] += HISTGET(src->bins[b]);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return a monotonic timestamp, in nanoseconds
+// ============================================================================
+u64 histNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+
+
+// ============================================================================
+// Return the value below which 'pct' percent of recorded values fall.  The
+// result is exact for min and max, and within one bin otherwise
+// ============================================================================
+u64 histPercentile(Hist* h, double pct) {
+  if (h->count == 0) return 0;
+  if (pct <= 0.0)    return h->min;
+  if (pct >= 100.0)  return h->max;
+
+  u64 rank = (u64)(pct / 100.0 * h->count + 0.5);
+  if (rank == 0) rank = 1;
+
+  u64 seen = 0;
+  for (i32 b = 0; b < NUMHISTBINS; ++b) {
+    seen += h->bins[b];
+    if (seen >= rank) {
+      u64 v = histBinValue(b);
+      if (v < h->min) v = h->min;
+      if (v > h->max) v = h->max;
+      return v;
+    }
+  }
+  return h->max;
+}
+
+
+
+// ============================================================================
+// Record one value of 'ns' nanoseconds
+// ============================================================================
+i32 histRecord(Hist* h, u64 ns) {
+  i32 bin = histBin(ns);
+  if (h->count == 0 || ns < h->min) HISTSET(h->min, ns);
+  if (ns > h->max) HISTSET(h->max, ns);
+  HISTSET(h->count, h->count + 1);
+  HISTSET(h->sum, h->sum + ns);
+  HISTSET(h->bins[bin], h->bins[bin] + 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Discard every value recorded in 'h'
+// ============================================================================
+i32 histReset(Hist* h) {
+  HISTSET(h->count, 0);
+  HISTSET(h->sum, 0);
+  HISTSET(h->min, 0);
+  HISTSET(h->max, 0);
+  for (i32 b = 0; b < NUMHISTBINS; ++b) HISTSET(h->bins[b], 0);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Sleep for 'ms' milliseconds
+// ============================================================================
+i32 histSleep(i32 ms) {
+  if (ms <= 0) return 0;
+  return histSleepNs((u64)ms * 1000000ULL);
+}
+
+
+
+// ============================================================================
+// Sleep for 'ns' nanoseconds, for waits finer than a millisecond
+// ============================================================================
+i32 histSleepNs(u64 ns) {
+  struct timespec ts = { ns / 1000000000ULL, ns % 1000000000ULL };
+  nanosleep(&ts, NULL);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the next pseudo-random number from 'state' (xorshift32), which must
+// not be 0.  Each caller keeps its own state, so that a given seed always
+// produces the same sequence
+// ============================================================================
+u32 xorshift(u32* state) {
+  u32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
@@ -0,0 +1,37 @@
+#ifndef HIST_H
+#define HIST_H
+
+// ===================================================================
+// hist.h - HDR-style latency histograms.  Values (nanoseconds) are
+// binned log-linearly: each power of two is split into HISTSUB equal
+// sub-buckets, so every bin is within 1/HISTSUB of its true value.
+// Also the clock the tools share, histNow, their sleeps, histSleep
+// and histSleepNs, and their pseudo-random generator, xorshift
+// ===================================================================
+
+#include "alias.h"
+
+#define HISTSUBBITS   4                   // log2 of sub-buckets per octave
+#define HISTSUB       (1 << HISTSUBBITS)  // eg: 16 => ~6% precision
+#define HISTMAXBITS   40                  // values >= 2^40 ns (~18 min) clamp
+#define NUMHISTBINS   (HISTSUB + (HISTMAXBITS - HISTSUBBITS) * HISTSUB)
+
+typedef struct {                          // Hist
+  u64 count;                              // # values recorded
+  u64 sum;                                // sum of values, for the mean
+  u64 min;                                // smallest value recorded
+  u64 max;                                // largest value recorded
+  u64 bins[NUMHISTBINS];                  // # values in each bin
+} Hist;
+
+u64 histBinValue (i32 bin);
+i32 histMerge    (Hist* dst, Hist* src);
+u64 histNow      ();
+u64 histPercentile(Hist* h, double pct);
+i32 histRecord   (Hist* h, u64 ns);
+i32 histReset    (Hist* h);
+i32 histSleep    (i32 ms);
+i32 histSleepNs  (u64 ns);
+u32 xorshift     (u32* state);
+
+#endif
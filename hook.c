@@ -0,0 +1,43 @@
+// ============================================================================
+// hook.c - static tracepoint registry
+// ============================================================================
+
+#include <stdio.h>
+
+#include "errors.h"
+#include "hook.h"
+
+#ifdef BFSHOOKS
+HookFn g_hooks  [NUMHOOKS];             // callback per tracepoint; NULL => off
+void*  g_hookCtx[NUMHOOKS];             // passed back to each callback
+#endif
+
+
+
+// ============================================================================
+// Call 'fn' with 'ctx' every time tracepoint 'point' is reached, replacing
+// any callback already registered there.  Register before the tracepoint
+// can fire on other threads.  On success, return 0.  If BFS was compiled
+// without BFSHOOKS, return ENYI
+// ============================================================================
+i32 hookRegister(i32 point, HookFn fn, void* ctx) {
+  if (point < 0 || point >= NUMHOOKS) return EBADHOOK;
+#ifdef BFSHOOKS
+  g_hookCtx[point] = ctx;
+  g_hooks[point]   = fn;
+  return 0;
+#else
+  (void)fn;
+  (void)ctx;
+  return ENYI;
+#endif
+}
+
+
+
+// ============================================================================
+// Stop calling back from tracepoint 'point'
+// ============================================================================
+i32 hookUnregister(i32 point) {
+  return hookRegister(point, NULL, NULL);
+}
@@ -0,0 +1,50 @@
+#ifndef HOOK_H
+#define HOOK_H
+
+// ===================================================================
+// hook.h - static tracepoints, for plugging BFS into outside telemetry.
+// The application registers one callback per tracepoint at runtime.
+//
+// Tracepoints exist only when BFS is compiled with -DBFSHOOKS.  Without
+// it, HOOK expands to nothing and hookRegister returns ENYI.  With it, an
+// unregistered tracepoint costs one predictable branch
+// ===================================================================
+
+#include "alias.h"
+
+#define HKBIOREAD     0   // bioRead entry:   a = dbn
+#define HKBIOREADEND  1   // bioRead exit:    a = dbn, b = latency (ns)
+#define HKBIOWRITE    2   // bioWrite entry:  a = dbn
+#define HKBIOWRITEEND 3   // bioWrite exit:   a = dbn, b = latency (ns)
+#define HKALLOC       4   // block taken from Freelist:    a = dbn
+#define HKFREE        5   // block returned to Freelist:   a = dbn
+#define HKINODEREAD   6   // Inode read:      a = inum, b = size
+#define HKINODEWRITE  7   // Inode written:   a = inum, b = size
+#define HKOFTLOOKUP   8   // OFT lookup:      a = inum, b = OFT index
+#define HKCACHEHIT    9   // block cache hit:  a = dbn, b = IOREAD/IOWRITE
+#define HKCACHEMISS   10  // block cache miss: a = dbn, b = IOREAD/IOWRITE
+#define NUMHOOKS      11
+
+typedef void (*HookFn)(i32 point, i64 a, i64 b, void* ctx);
+
+#ifdef BFSHOOKS
+
+extern HookFn g_hooks  [NUMHOOKS];
+extern void*  g_hookCtx[NUMHOOKS];
+
+#define HOOK(point, a, b)                                               \
+  do {                                                                  \
+    if (__builtin_expect(g_hooks[point] != NULL, 0))                    \
+      g_hooks[point](point, (i64)(a), (i64)(b), g_hookCtx[point]);      \
+  } while (0)
+
+#else
+
+#define HOOK(point, a, b) ((void)0)
+
+#endif
+
+i32 hookRegister  (i32 point, HookFn fn, void* ctx);
+i32 hookUnregister(i32 point);
+
+#endif
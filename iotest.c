@@ -0,0 +1,336 @@
+// ============================================================================
+// iotest.c : check that canonical operations issue no more bio calls than
+// they should.  p5test checks what BFS returns; this checks what it costs
+// ============================================================================
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bfs.h"
+#include "blk.h"
+#include "fs.h"
+#include "fsck.h"
+#include "iotest.h"
+#include "stats.h"
+
+static i32 g_ioFailures = 0;
+
+typedef struct {                  // bio calls since ioMark
+  u64 reads;
+  u64 writes;
+} IOCount;
+
+typedef struct {                  // ioTurns: one of two threads taking turns
+  i32 me;                         // 0 or 1
+  i32 dbn;                        // first block this thread reads
+} IOTurn;
+
+static pthread_mutex_t g_ioTurnLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_ioTurnCond = PTHREAD_COND_INITIALIZER;
+static i32             g_ioTurn     = 0;      // whose turn: 0 or 1
+
+// ============================================================================
+// Return the total bio reads and writes so far, over all ops and classes
+// ============================================================================
+static IOCount ioMark() {
+  IOStats st;
+  statsGet(&st);
+
+  IOCount c = {0, 0};
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    for (i32 bc = 0; bc < NUMBC; ++bc) {
+      c.reads  += st.io[op][bc][IOREAD];
+      c.writes += st.io[op][bc][IOWRITE];
+    }
+  }
+  return c;
+}
+
+
+
+// ============================================================================
+// Return the bio calls issued since 'start' was taken by ioMark
+// ============================================================================
+static IOCount ioSince(IOCount start) {
+  IOCount now = ioMark();
+  IOCount d = { now.reads - start.reads, now.writes - start.writes };
+  return d;
+}
+
+
+
+// ============================================================================
+// Thread body for test 11: read IOTURNS blocks from 'arg'->dbn up, one at a
+// time, taking turns with the other thread, so the disk sees the two runs
+// interleaved block by block
+// ============================================================================
+static void* ioTurns(void* arg) {
+  IOTurn* t = (IOTurn*)arg;
+  i8 buf[BYTESPERBLOCK];
+
+  for (i32 b = 0; b < IOTURNS; ++b) {
+    pthread_mutex_lock(&g_ioTurnLock);
+    while (g_ioTurn != t->me) pthread_cond_wait(&g_ioTurnCond, &g_ioTurnLock);
+    bioRead(t->dbn + b, buf);
+    g_ioTurn = 1 - t->me;
+    pthread_cond_broadcast(&g_ioTurnCond);
+    pthread_mutex_unlock(&g_ioTurnLock);
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Check that 'actual' bio calls for 'what' is no more than 'max'.  'testnum'
+// is the test number - used for reporting
+// ============================================================================
+i32 checkIO(i32 testnum, str what, u64 actual, u64 max) {
+  if (actual <= max) {
+    printf("IOTEST %d : GOOD : %-28s %3llu <= %llu \n", testnum, what,
+      (unsigned long long)actual, (unsigned long long)max);
+    return 0;
+  }
+  printf("IOTEST %d : BAD  : %-28s %3llu but should be <= %llu \n", testnum,
+    what, (unsigned long long)actual, (unsigned long long)max);
+  ++g_ioFailures;
+  return 1;
+}
+
+
+
+// ============================================================================
+// Check that 'actual' for 'what' is exactly 'expected'.  'testnum' is the
+// test number - used for reporting
+// ============================================================================
+static i32 checkEq(i32 testnum, str what, i64 actual, i64 expected) {
+  if (actual == expected) {
+    printf("IOTEST %d : GOOD : %-28s %3lld == %lld \n", testnum, what,
+      (long long)actual, (long long)expected);
+    return 0;
+  }
+  printf("IOTEST %d : BAD  : %-28s %3lld but should be %lld \n", testnum,
+    what, (long long)actual, (long long)expected);
+  ++g_ioFailures;
+  return 1;
+}
+
+
+
+// ============================================================================
+// Explain a read ('op' OPREAD) or write of 'len' bytes at 'offset' in the
+// file open on 'fd', then do it, and check that the bio reads, writes and
+// blocks allocated are what the plan said.  'testnum' and 'what' are used
+// for reporting
+// ============================================================================
+static void checkExplain(i32 testnum, str what, i32 fd, i32 op, i32 offset,
+                         i32 len, i8* buf) {
+  FsPlan plan;
+  if (fsExplain(fd, op, offset, len, &plan) != 0) {
+    printf("IOTEST %d : BAD  : %s: fsExplain failed \n", testnum, what);
+    ++g_ioFailures;
+    return;
+  }
+  u64 reads  = 0;
+  u64 writes = 0;
+  for (i32 s = 0; s < plan.numSteps && s < FSPLANSTEPS; ++s) {
+    if (plan.steps[s].rw == IOREAD) ++reads; else ++writes;
+  }
+
+  IOStats before;
+  IOStats after;
+  fsSeek(fd, offset, SEEK_SET);
+  statsGet(&before);
+  IOCount m = ioMark();
+  if (op == OPREAD) fsRead (fd, len, buf);
+  else              fsWrite(fd, len, buf);
+  IOCount c = ioSince(m);
+  statsGet(&after);
+
+  char label[40];
+  snprintf(label, sizeof(label), "%s: reads", what);
+  checkEq(testnum, label, c.reads, reads);
+  snprintf(label, sizeof(label), "%s: writes", what);
+  checkEq(testnum, label, c.writes, writes);
+  snprintf(label, sizeof(label), "%s: allocs", what);
+  checkEq(testnum, label, after.allocs - before.allocs, plan.allocs);
+}
+
+
+
+// ============================================================================
+// Run every I/O amplification test against a freshly formatted IOTESTDISK,
+// then restore the previous disk.  Return the number of failed checks
+// ============================================================================
+i32 iotest() {
+  str oldDisk = bioDisk();
+  bioSetDisk(IOTESTDISK);
+  fsFormat();
+  fsMount();
+
+  i8 buf[4 * BYTESPERBLOCK];
+  memset(buf, 1, sizeof(buf));
+  g_ioFailures = 0;
+
+  // TEST 1 : create a new file
+
+  IOCount m = ioMark();
+  i32 fd = fsCreate("IOTEST");
+  IOCount c = ioSince(m);
+  checkIO(1, "create: reads",  c.reads,  1);
+  checkIO(1, "create: writes", c.writes, 1);
+
+  // TEST 2 : append one aligned block to an empty file
+
+  m = ioMark();
+  fsWrite(fd, BYTESPERBLOCK, buf);
+  c = ioSince(m);
+  checkIO(2, "first block: reads",  c.reads,  8);
+  checkIO(2, "first block: writes", c.writes, 4);
+
+  // Grow the file out to IOTESTBLOCKS blocks, into the indirect block
+
+  for (i32 b = 1; b < IOTESTBLOCKS; ++b) fsWrite(fd, BYTESPERBLOCK, buf);
+  fsClose(fd);
+
+  // TEST 3 : open an existing file
+
+  m = ioMark();
+  fd = fsOpen("IOTEST");
+  c = ioSince(m);
+  checkIO(3, "open: reads",  c.reads,  1);
+  checkIO(3, "open: writes", c.writes, 0);
+
+  // TEST 4 : read 4 aligned blocks mapped by direct[]
+
+  fsSeek(fd, 0, SEEK_SET);
+  m = ioMark();
+  fsRead(fd, 4 * BYTESPERBLOCK, buf);
+  c = ioSince(m);
+  checkIO(4, "read 4 direct: reads",  c.reads,  9);
+  checkIO(4, "read 4 direct: writes", c.writes, 0);
+
+  // TEST 5 : read 4 aligned blocks mapped by the indirect block
+
+  fsSeek(fd, 10 * BYTESPERBLOCK, SEEK_SET);
+  m = ioMark();
+  fsRead(fd, 4 * BYTESPERBLOCK, buf);
+  c = ioSince(m);
+  checkIO(5, "read 4 indirect: reads",  c.reads,  13);
+  checkIO(5, "read 4 indirect: writes", c.writes, 0);
+
+  // TEST 6 : overwrite one aligned block in place
+
+  fsSeek(fd, 2 * BYTESPERBLOCK, SEEK_SET);
+  m = ioMark();
+  fsWrite(fd, BYTESPERBLOCK, buf);
+  c = ioSince(m);
+  checkIO(6, "overwrite block: reads",  c.reads,  2);
+  checkIO(6, "overwrite block: writes", c.writes, 1);
+
+  // TEST 7 : append one aligned block past the direct[] blocks
+
+  fsSeek(fd, 0, SEEK_END);
+  m = ioMark();
+  fsWrite(fd, BYTESPERBLOCK, buf);
+  c = ioSince(m);
+  checkIO(7, "append block: reads",  c.reads,  10);
+  checkIO(7, "append block: writes", c.writes, 4);
+
+  // TEST 8 : seek, tell and close touch no blocks
+
+  m = ioMark();
+  fsSeek(fd, 0, SEEK_SET);
+  fsTell(fd);
+  fsClose(fd);
+  c = ioSince(m);
+  checkIO(8, "seek+tell+close: bio calls", c.reads + c.writes, 0);
+
+  // TEST 9 : fsExplain's plan matches what a read, an overwrite and an
+  // append then really do
+
+  fd = fsOpen("IOTEST");
+  i32 size = fsSize(fd);
+  checkExplain(9, "explain read", fd, OPREAD, 3 * BYTESPERBLOCK + 100,
+    3 * BYTESPERBLOCK, buf);
+  checkExplain(9, "explain overwrite", fd, OPWRITE, 4 * BYTESPERBLOCK + 200,
+    600, buf);
+  checkExplain(9, "explain append", fd, OPWRITE, size,
+    2 * BYTESPERBLOCK + 10, buf);
+  fsClose(fd);
+
+  // TEST 10 : fsExplain turns away an fd that is not open, or out of range
+
+  FsPlan plan;
+  checkEq(10, "explain closed fd",
+    fsExplain(fd, OPREAD, 0, 1, &plan), EBADINUM);
+  checkEq(10, "explain fd out of range",
+    fsExplain(INUMTOFD + NUMINODES, OPREAD, 0, 1, &plan), EBADINUM);
+
+  // TEST 11 : a bio trace from two threads is profiled in the order the
+  // reads were issued, not one thread's ring after the other's.  The two
+  // sequential runs reach the disk interleaved, so no read is sequential
+  // and every move is a seek, forward and back in turn
+
+  IOTurn    turns[2] = { { 0, 40 }, { 1, 60 } };
+  pthread_t tid[2];
+  g_ioTurn = 0;
+  blkTraceStart(IOTESTTRACE);
+  for (i32 t = 0; t < 2; ++t) {
+    pthread_create(&tid[t], NULL, ioTurns, &turns[t]);
+  }
+  for (i32 t = 0; t < 2; ++t) pthread_join(tid[t], NULL);
+  blkTraceStop();
+
+  BlkProfile prof;
+  blkProfile(IOTESTTRACE, &prof);
+  checkEq(11, "two-thread trace: events", prof.num, 2 * IOTURNS);
+  checkEq(11, "two-thread trace: sequential", prof.seq, 0);
+  checkEq(11, "two-thread trace: forward", prof.fwd, IOTURNS);
+  checkEq(11, "two-thread trace: backward", prof.back, IOTURNS - 1);
+
+  remove(IOTESTTRACE);
+
+  // TEST 12 : appending to a part-filled last block, and writing past EOF,
+  // keep every byte already written, and allocate only the blocks the file
+  // grows into.  Bytes 0-99 hold 1, 100-699 hold 2, the gap 700-1999 reads
+  // as 0, and 2000-2099 hold 3: 5 blocks in all
+
+  i8 data[2100];
+  IOStats before;
+  IOStats after;
+  statsGet(&before);
+  fd = fsCreate("APPEND");
+  memset(data, 1, 100);
+  fsWrite(fd, 100, data);
+  memset(data, 2, 600);
+  fsWrite(fd, 600, data);
+  fsSeek(fd, 2000, SEEK_SET);
+  memset(data, 3, 100);
+  fsWrite(fd, 100, data);
+  statsGet(&after);
+
+  memset(data, -1, sizeof(data));
+  fsSeek(fd, 0, SEEK_SET);
+  checkEq(12, "append: bytes read", fsRead(fd, sizeof(data), data),
+    sizeof(data));
+  fsClose(fd);
+
+  i32 wrong = 0;
+  for (i32 i = 0; i < (i32)sizeof(data); ++i) {
+    i8 want = (i < 100) ? 1 : (i < 700) ? 2 : (i < 2000) ? 0 : 3;
+    if (data[i] != want) ++wrong;
+  }
+  checkEq(12, "append: bytes wrong", wrong, 0);
+  checkEq(12, "append: blocks allocated", after.allocs - before.allocs, 5);
+
+  FsckReport fsck;
+  fsckRun(0, &fsck);
+  checkEq(12, "append: blocks leaked", fsck.leaked, 0);
+
+  remove(IOTESTDISK);
+  bioSetDisk(oldDisk);
+
+  return g_ioFailures;
+}
@@ -0,0 +1,23 @@
+#ifndef IOTEST_H
+#define IOTEST_H
+
+// ===================================================================
+// iotest.h - I/O amplification tests.  Each test performs a canonical
+// operation on a freshly formatted scratch disk and checks that the
+// number of bioRead/bioWrite calls it issued stays under a bound, or,
+// for fsExplain, is exactly what the plan said it would be.  A bio
+// trace taken from two threads must profile in issue order, and an
+// append must keep the bytes already in a part-filled last block
+// ===================================================================
+
+#include "alias.h"
+
+#define IOTESTDISK    "IOTESTDISK"
+#define IOTESTBLOCKS  20          // blocks in the test file
+#define IOTESTTRACE   "IOTESTTRACE"
+#define IOTURNS       10          // blocks each thread reads in test 11
+
+i32 checkIO(i32 testnum, str what, u64 actual, u64 max);
+i32 iotest();
+
+#endif
@@ -1,11 +1,358 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "bench.h"
 #include "bfs.h"
+#include "blk.h"
+#include "deb.h"
+#include "defrag.h"
 #include "errors.h"
+#include "fsck.h"
+#include "fscktest.h"
+#include "gen.h"
+#include "heat.h"
+#include "hist.h"
+#include "iotest.h"
+#include "metrics.h"
+#include "mon.h"
 #include "p5test.h"
+#include "prof.h"
+#include "res.h"
+#include "sim.h"
+#include "stress.h"
+#include "trace.h"
 
-int main() {
+// ============================================================================
+// With no arguments, run the P5 tests against BFSDISK.  Otherwise run the
+// tool named by the first argument:
+//
+//   a.out bench aging [STEPS]        aged versus freshly written reads
+//   a.out bench alloc [CYCLES]       allocator benchmark
+//   a.out bench backends [ROUNDS]    every bio backend and cache size,
+//                                    on the same workloads
+//   a.out bench meta [ITERS]         create/open/stat/close/delete rates,
+//                                    single- and multi-threaded
+//   a.out bench mount [ROUNDS]       format, cold mount, first read and
+//                                    cache warm-up times
+//   a.out bench profile [BLOCKS]     where each fs.h call spends its time,
+//                                    by layer; needs -DBFSPROF
+//   a.out bfstop [SEGMENT] [FRAMES]  live view of the BFS instance
+//                                    publishing into SEGMENT (default:
+//                                    /bfs); FRAMES 0 runs until killed
+//   a.out blkparse BLKTRACE          analyze a bio trace
+//   a.out cachesim BLKTRACE [RATE]   cache miss-ratio curves from a bio
+//                                    trace, SHARDS-sampled at RATE
+//   a.out compare BASE CUR           compare two benchmark results files;
+//                                    exit status 1 if anything got worse
+//   a.out defrag [DISK] [-o] [-r RATE]
+//                                    make each file of DISK (default:
+//                                    BFSDISK) contiguous: offline, or with
+//                                    -o online, moving at most RATE blocks
+//                                    a second
+//   a.out explain FILE read|write OFFSET LEN [DISK]
+//                                    the bio calls that request would make,
+//                                    without making them
+//   a.out fsck [DISK] [-j THREADS]   check DISK (default: BFSDISK) for
+//                                    consistency; exit status 1 if not
+//   a.out fscktest                   run the fsck and defrag tests on
+//                                    damaged disks; exit status 1 if any
+//                                    failed
+//   a.out heatmap HEAT               draw a per-block heat map
+//   a.out iotest                     run the I/O amplification tests;
+//                                    exit status 1 if any failed
+//   a.out layout [DISK]              file layout and free-space report
+//   a.out mkimage DISK [OPTIONS]     build a populated disk from a spec:
+//                                    -f FILES, -s MIN-MAX bytes, -d
+//                                    uniform|log, -g FRAG%, -p
+//                                    zero|fbn|random, -r SEED
+//   a.out replay TRACE [DISK] [-t] [-b BACKEND] [-c BLOCKS]
+//                                    replay TRACE against DISK (default:
+//                                    BFSDISK); -t keeps original timing,
+//                                    -b picks the bio backend (stdio,
+//                                    pread, mmap, direct, aio, ram), -c
+//                                    puts a BLOCKS-block cache in front
+//   a.out stress [SECS] [THREADS] [-d RATE]
+//                                    multi-threaded stress, checked against
+//                                    a shadow copy; exit status 1 if any
+//                                    check failed.  -d runs the online
+//                                    defragmenter alongside, at RATE
+//                                    blocks a second (0: no cap)
+//
+// Any benchmark also takes "-n REPS", to run it REPS times over, and
+// "-o FILE", to save its results as CSV, or as JSON if FILE ends in .json
+//
+// Whatever runs, if environment variable BFSTRACE names a file, every fs.h
+// call is traced into it; if BFSBLKTRACE names a file, every bio call is
+// traced into it; if BFSHEAT names a file, a heat map of the bio calls on
+// every block, against the layout of the disk in use at the end, is saved
+// into it; if BFSMON names a shared-memory segment (eg: /bfs), live
+// statistics are published into it, for bfstop; if BFSMETRICS names a file,
+// or "unix:PATH", every counter is exported there in OpenMetrics text, every
+// BFSMETRICSMS milliseconds (default: 15000)
+// ============================================================================
+static void usage() {
+  printf("usage: a.out                            run the P5 tests \n");
+  printf("       a.out bench aging [STEPS]        aging benchmark \n");
+  printf("       a.out bench alloc [CYCLES]       allocator benchmark \n");
+  printf("       a.out bench backends [ROUNDS]    bio backend benchmark \n");
+  printf("       a.out bench meta [ITERS]         metadata benchmark \n");
+  printf("       a.out bench mount [ROUNDS]       startup benchmark \n");
+  printf("       a.out bench profile [BLOCKS]     per-layer profile \n");
+  printf("       a.out bfstop [SEGMENT] [FRAMES]  live monitor \n");
+  printf("       a.out blkparse BLKTRACE          analyze a bio trace \n");
+  printf("       a.out cachesim BLKTRACE [RATE]   cache miss-ratio curves \n");
+  printf("       a.out compare BASE CUR           compare bench results \n");
+  printf("       a.out defrag [DISK] [-o] [-r RATE] defragmenter \n");
+  printf("       a.out explain FILE read|write OFFSET LEN [DISK] \n");
+  printf("       a.out fsck [DISK] [-j THREADS]   consistency check \n");
+  printf("       a.out fscktest                   fsck tests \n");
+  printf("       a.out heatmap HEAT               draw a heat map \n");
+  printf("       a.out iotest                     I/O amplification tests \n");
+  printf("       a.out layout [DISK]              layout report \n");
+  printf("       a.out mkimage DISK [OPTIONS]     build a synthetic disk \n");
+  printf("       a.out replay TRACE [DISK] [-t] [-b BACKEND] [-c BLOCKS] "
+    "replay an fs trace \n");
+  printf("       a.out stress [SECS] [THREADS] [-d RATE] stress \n");
+  printf("bench options: -n REPS  -o FILE[.json] \n");
+  printf("mkimage options: -f FILES  -s MIN-MAX  -d uniform|log  -g FRAG  "
+    "-p zero|fbn|random  -r SEED \n");
+}
+
+static int run(int argc, str argv[]) {
+  if (argc < 2) {
+    p5test();
+    return 0;
+  }
+
+  if (strcmp(argv[1], "bench") == 0 && argc >= 3) {
+    i32 arg  = 0;
+    i32 reps = 1;
+    str out  = NULL;
+    for (i32 a = 3; a < argc; ++a) {
+      i32 more = (a + 1 < argc);
+      if      (strcmp(argv[a], "-n") == 0 && more) reps = atoi(argv[++a]);
+      else if (strcmp(argv[a], "-o") == 0 && more) out  = argv[++a];
+      else                                         arg  = atoi(argv[a]);
+    }
+
+    i32 known = 1;
+    for (i32 r = 0; r < reps && known; ++r) {
+      str b = argv[2];
+      if      (strcmp(b, "aging")    == 0) benchAging   (arg ? arg : 2000, 1);
+      else if (strcmp(b, "alloc")    == 0) benchAlloc   (arg ? arg : 10, 1);
+      else if (strcmp(b, "backends") == 0) benchBackends(arg ? arg : 20, 1);
+      else if (strcmp(b, "meta")     == 0) benchMeta    (arg ? arg : 200);
+      else if (strcmp(b, "mount")    == 0) benchMount   (arg ? arg : 5);
+      else if (strcmp(b, "profile")  == 0) benchProfile (arg ? arg : 40);
+      else known = 0;
+    }
+    if (known) {
+      if (out != NULL) resWrite(out);
+      return 0;
+    }
+  }
+
+  if (strcmp(argv[1], "bfstop") == 0) {
+    str name = (argc >= 3) ? argv[2] : MONNAME;
+    i32 ret  = monTop(name, (argc >= 4) ? atoi(argv[3]) : 0);
+    if (ret == ENODISK) printf("bfstop: no segment %s; is BFSMON set? \n",
+                               name);
+    if (ret == ENYI)    printf("bfstop: nothing published in %s \n", name);
+    if (ret == ESTALESHM) {
+      printf("bfstop: %s is stale: its publisher stopped mid-update \n",
+        name);
+    }
+    return ret == 0 ? 0 : 1;
+  }
+
+  if (strcmp(argv[1], "blkparse") == 0 && argc >= 3) {
+    blkAnalyze(argv[2]);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "cachesim") == 0 && argc >= 3) {
+    simMissRatios(argv[2], argc >= 4 ? atof(argv[3]) : 1.0);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "compare") == 0 && argc >= 4) {
+    return resCompare(argv[2], argv[3]) == 0 ? 0 : 1;
+  }
+
+  if (strcmp(argv[1], "defrag") == 0) {
+    i32 online = 0;
+    i32 rate   = 0;
+    for (i32 a = 2; a < argc; ++a) {
+      i32 more = (a + 1 < argc);
+      if      (strcmp(argv[a], "-o") == 0)         online = 1;
+      else if (strcmp(argv[a], "-r") == 0 && more) rate   = atoi(argv[++a]);
+      else                                         bioSetDisk(argv[a]);
+    }
+    DefragReport rep;
+    if (online) {
+      fsMount();
+      defragOnline(rate, &rep);
+    } else if (defragOffline(&rep) != 0) {
+      printf("defrag: %s is inconsistent; not defragmented \n", bioDisk());
+      return 1;
+    }
+    printf("DEFRAG : %s : %d files, %d moved, %d skipped; %d blocks moved; "
+      "extents %d -> %d; %.1f us \n", online ? "online " : "offline",
+      rep.files, rep.moved, rep.skipped, rep.blocks, rep.extentsBefore,
+      rep.extentsAfter, rep.ns / 1e3);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "explain") == 0 && argc >= 6) {
+    if (argc >= 7) bioSetDisk(argv[6]);
+    fsMount();
+    i32 fd = fsOpen(argv[2]);
+    if (fd < 0) {
+      printf("%s: no such file \n", argv[2]);
+      return 1;
+    }
+    FsPlan plan;
+    i32 op  = (strcmp(argv[3], "write") == 0) ? OPWRITE : OPREAD;
+    i32 ret = fsExplain(fd, op, atoi(argv[4]), atoi(argv[5]), &plan);
+    fsClose(fd);
+    if (ret != 0) {
+      RepError(ret);
+      return 1;
+    }
+    debDumpPlan(&plan);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "fsck") == 0) {
+    i32 threads = FSCKTHREADS;
+    for (i32 a = 2; a < argc; ++a) {
+      i32 more = (a + 1 < argc);
+      if (strcmp(argv[a], "-j") == 0 && more) threads = atoi(argv[++a]);
+      else                                    bioSetDisk(argv[a]);
+    }
+    FsckReport rep;
+    return fsckRun(threads, &rep) == 0 ? 0 : 1;
+  }
+
+  if (strcmp(argv[1], "fscktest") == 0) {
+    return fscktest() == 0 ? 0 : 1;
+  }
+
+  if (strcmp(argv[1], "heatmap") == 0 && argc >= 3) {
+    heatRender(argv[2]);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "iotest") == 0) {
+    return iotest() == 0 ? 0 : 1;
+  }
+
+  if (strcmp(argv[1], "layout") == 0) {
+    if (argc >= 3) bioSetDisk(argv[2]);
+    debDumpLayout();
+    return 0;
+  }
+
+  if (strcmp(argv[1], "mkimage") == 0 && argc >= 3) {
+    GenSpec spec = { NUMINODES, 0, 8 * BYTESPERBLOCK, GENUNIFORM, 0, GENFBN,
+                     1 };
+    for (i32 a = 3; a + 1 < argc; a += 2) {
+      str o = argv[a];
+      str v = argv[a + 1];
+      if      (strcmp(o, "-f") == 0) spec.files = atoi(v);
+      else if (strcmp(o, "-g") == 0) spec.frag  = atoi(v);
+      else if (strcmp(o, "-r") == 0) spec.seed  = strtoul(v, NULL, 0);
+      else if (strcmp(o, "-s") == 0) {
+        sscanf(v, "%d-%d", &spec.minSize, &spec.maxSize);
+      } else if (strcmp(o, "-d") == 0) {
+        spec.dist = (strcmp(v, "log") == 0) ? GENLOG : GENUNIFORM;
+      } else if (strcmp(o, "-p") == 0) {
+        spec.pattern = (strcmp(v, "zero")   == 0) ? GENZERO
+                     : (strcmp(v, "random") == 0) ? GENRANDOM : GENFBN;
+      }
+    }
+    bioSetDisk(argv[2]);
+    u64 t0 = histNow();
+    i32 blocks = genImage(argv[2], &spec);
+    printf("\n%s: %d blocks of data, built in %.1f us \n", argv[2], blocks,
+      (histNow() - t0) / 1e3);
+    debDumpLayout();
+    return 0;
+  }
+
+  if (strcmp(argv[1], "replay") == 0 && argc >= 3) {
+    i32 timed   = 0;
+    str backend = NULL;
+    i32 cache   = 0;
+    for (i32 a = 3; a < argc; ++a) {
+      i32 more = (a + 1 < argc);
+      if      (strcmp(argv[a], "-t") == 0)         timed   = 1;
+      else if (strcmp(argv[a], "-b") == 0 && more) backend = argv[++a];
+      else if (strcmp(argv[a], "-c") == 0 && more) cache   = atoi(argv[++a]);
+      else                                         bioSetDisk(argv[a]);
+    }
+    if (backend != NULL) {                    // after bioSetDisk: it opens
+      i32 b = 0;
+      while (b < NUMBIO && strcmp(backend, bioBackendName(b)) != 0) ++b;
+      if (bioSetBackend(b) != 0) {
+        printf("%s: no such backend, or not on this host \n", backend);
+        return 1;
+      }
+    }
+    bioSetCache(cache);
+    traceReplay(argv[2], timed);
+    debDumpStats();
+    debDumpFiles();
+    debDumpIO();
+    debDumpLatency();
+    profDump();
+    return 0;
+  }
+
+  if (strcmp(argv[1], "stress") == 0) {
+    i32 secs    = 2;
+    i32 threads = 8;
+    i32 defrag  = -1;                         // no defragmenter
+    i32 num     = 0;
+    for (i32 a = 2; a < argc; ++a) {
+      i32 more = (a + 1 < argc);
+      if      (strcmp(argv[a], "-d") == 0 && more) defrag  = atoi(argv[++a]);
+      else if (num++ == 0)                         secs    = atoi(argv[a]);
+      else                                         threads = atoi(argv[a]);
+    }
+    return stressRun(secs, threads, defrag) == 0 ? 0 : 1;
+  }
+
+  usage();
+  return 1;
+}
+
+
+
+int main(int argc, str argv[]) {
   bfsInitOFT();
-  p5test();
-  return 0;
-}
\ No newline at end of file
+
+  str trace = getenv("BFSTRACE");
+  if (trace != NULL) traceStart(trace);
+  str blktrace = getenv("BFSBLKTRACE");
+  if (blktrace != NULL) blkTraceStart(blktrace);
+  str mon = getenv("BFSMON");
+  if (mon != NULL) monStart(mon);
+  str metrics = getenv("BFSMETRICS");
+  str metricsMs = getenv("BFSMETRICSMS");
+  if (metrics != NULL) {
+    metricsStart(metrics, metricsMs != NULL ? atoi(metricsMs) : 0);
+  }
+
+  int ret = run(argc, argv);
+
+  str heat = getenv("BFSHEAT");
+  if (heat != NULL) heatWrite(heat);
+  metricsStop();
+  monStop();
+  bioClose();
+  traceStop();
+  blkTraceStop();
+  return ret;
+}
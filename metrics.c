@@ -0,0 +1,331 @@
+// ============================================================================
+// metrics.c - OpenMetrics exporter for the BFS counters
+// ============================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "dev.h"
+#include "fs.h"
+#include "hist.h"
+#include "metrics.h"
+
+#define METRICSSLICEMS 100        // how often the thread checks for stop
+
+static str        g_metricsTarget = NULL;   // file, or "unix:" + socket path
+static i32        g_metricsMs     = METRICSMS;
+static i32        g_metricsSock   = -1;     // listening socket, if any
+static pthread_t  g_metricsTid;
+static atomic_int g_metricsStop   = 0;      // thread finishes when set
+static i32        g_metricsRun    = 0;      // thread running?
+
+static str g_metricsRw[2] = { "read", "write" };
+
+
+
+// ============================================================================
+// Print 's' as an OpenMetrics label value: quotes, backslashes and newlines
+// escaped
+// ============================================================================
+static void metricsLabel(FILE* fp, str s) {
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') fputc('\\', fp);
+    if (*s == '\n') { fputs("\\n", fp); continue; }
+    fputc(*s, fp);
+  }
+}
+
+
+
+// ============================================================================
+// Print the HELP and TYPE lines of metric family 'name'
+// ============================================================================
+static void metricsFamily(FILE* fp, str name, str type, str help) {
+  fprintf(fp, "# TYPE %s %s\n", name, type);
+  fprintf(fp, "# HELP %s %s\n", name, help);
+}
+
+
+
+// ============================================================================
+// Print latency histogram 'h' as samples of family bfs_latency_seconds,
+// labelled call="'call'".  Buckets are powers of two nanoseconds, which bin
+// edges of hist.c fall on, so each count is exact for values below 'le'
+// ============================================================================
+static void metricsHist(FILE* fp, str call, Hist* h) {
+  i32 b = 0;
+  u64 below = 0;
+  for (i32 k = METRICSMINLE; k <= METRICSMAXLE; ++k) {
+    u64 le = 1ULL << k;
+    for (; b < NUMHISTBINS && histBinValue(b) < le; ++b) below += h->bins[b];
+    fprintf(fp, "bfs_latency_seconds_bucket{call=\"%s\",le=\"%.9g\"} %llu\n",
+      call, le / 1e9, (unsigned long long)below);
+  }
+  fprintf(fp, "bfs_latency_seconds_bucket{call=\"%s\",le=\"+Inf\"} %llu\n",
+    call, (unsigned long long)h->count);
+  fprintf(fp, "bfs_latency_seconds_count{call=\"%s\"} %llu\n", call,
+    (unsigned long long)h->count);
+  fprintf(fp, "bfs_latency_seconds_sum{call=\"%s\"} %.9f\n", call,
+    h->sum / 1e9);
+}
+
+
+
+// ============================================================================
+// Print every BFS counter and histogram into 'fp', in the OpenMetrics text
+// format, ending with "# EOF".  Counters run from when counting started or
+// was last reset.  Return 0
+// ============================================================================
+i32 metricsWrite(FILE* fp) {
+  if (fp == NULL) FATAL(ENULLPTR);
+
+  IOStats io;
+  FsStats fs;
+  statsGet(&io);
+  fsGetStats(&fs);
+
+  metricsFamily(fp, "bfs_calls", "counter", "fs.h calls, by call");
+  for (i32 op = 1; op < NUMOPS; ++op) {
+    fprintf(fp, "bfs_calls_total{call=\"%s\"} %llu\n", statsOpName(op),
+      (unsigned long long)io.calls[op]);
+  }
+
+  metricsFamily(fp, "bfs_bio", "counter",
+    "bio calls, by the fs.h call that made them, block class and direction");
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    for (i32 bc = 0; bc < NUMBC; ++bc) {
+      for (i32 rw = 0; rw < 2; ++rw) {
+        if (io.io[op][bc][rw] == 0) continue;
+        fprintf(fp, "bfs_bio_total{call=\"%s\",class=\"%s\",rw=\"%s\"} "
+          "%llu\n", statsOpName(op), statsClassName(bc), g_metricsRw[rw],
+          (unsigned long long)io.io[op][bc][rw]);
+      }
+    }
+  }
+
+  metricsFamily(fp, "bfs_bytes", "counter", "bytes moved by fsRead, fsWrite");
+  for (i32 rw = 0; rw < 2; ++rw) {
+    fprintf(fp, "bfs_bytes_total{rw=\"%s\"} %llu\n", g_metricsRw[rw],
+      (unsigned long long)io.bytes[rw]);
+  }
+  metricsFamily(fp, "bfs_device_blocks", "counter",
+    "blocks moved by the bio backend");
+  for (i32 rw = 0; rw < 2; ++rw) {
+    fprintf(fp, "bfs_device_blocks_total{rw=\"%s\"} %llu\n", g_metricsRw[rw],
+      (unsigned long long)io.dev[rw]);
+  }
+
+  metricsFamily(fp, "bfs_cache_hits", "counter", "bio calls served by cache");
+  fprintf(fp, "bfs_cache_hits_total %llu\n", (unsigned long long)io.hits);
+  metricsFamily(fp, "bfs_cache_misses", "counter", "bio calls missing cache");
+  fprintf(fp, "bfs_cache_misses_total %llu\n", (unsigned long long)io.misses);
+  metricsFamily(fp, "bfs_cache_dirty_blocks", "gauge",
+    "cached blocks not yet written back");
+  fprintf(fp, "bfs_cache_dirty_blocks %d\n", fs.dirty);
+  metricsFamily(fp, "bfs_allocs", "counter", "blocks taken from Freelist");
+  fprintf(fp, "bfs_allocs_total %llu\n", (unsigned long long)io.allocs);
+  metricsFamily(fp, "bfs_frees", "counter", "blocks returned to Freelist");
+  fprintf(fp, "bfs_frees_total %llu\n", (unsigned long long)io.frees);
+  metricsFamily(fp, "bfs_errors", "counter", "error codes fs.h returned");
+  fprintf(fp, "bfs_errors_total %llu\n", (unsigned long long)io.errors);
+  metricsFamily(fp, "bfs_oft_entries_used", "gauge", "OFT entries in use");
+  fprintf(fp, "bfs_oft_entries_used %d\n", fs.oftUsed);
+  metricsFamily(fp, "bfs_oft_entries", "gauge", "OFT capacity");
+  fprintf(fp, "bfs_oft_entries %d\n", fs.oftSize);
+
+  metricsFamily(fp, "bfs_latency_seconds", "histogram",
+    "latency of fs.h calls and of bioRead and bioWrite");
+  for (i32 l = 1; l < NUMLAT; ++l) {
+    Hist h;
+    statsGetHist(l, &h);
+    metricsHist(fp, statsLatName(l), &h);
+  }
+
+  FileStats top[NUMINODES];
+  i32 num = fsTopFiles(top, NUMINODES);
+  metricsFamily(fp, "bfs_file_calls", "counter", "fs.h calls, by file");
+  for (i32 i = 0; i < num; ++i) {
+    char name[FNAMESIZE];
+    statsGetName(top[i].inum, name);
+    for (i32 op = 1; op < NUMOPS; ++op) {
+      if (top[i].ops[op] == 0) continue;
+      fprintf(fp, "bfs_file_calls_total{inum=\"%d\",file=\"", top[i].inum);
+      metricsLabel(fp, name);
+      fprintf(fp, "\",call=\"%s\"} %llu\n", statsOpName(op),
+        (unsigned long long)top[i].ops[op]);
+    }
+  }
+
+  str fileNames[] = { "bfs_file_bytes", "bfs_file_bio" };
+  str fileHelp [] = { "bytes moved by fs.h calls, by file",
+                      "bio calls made for fs.h calls, by file" };
+  for (i32 m = 0; m < 2; ++m) {
+    metricsFamily(fp, fileNames[m], "counter", fileHelp[m]);
+    for (i32 i = 0; i < num; ++i) {
+      char name[FNAMESIZE];
+      statsGetName(top[i].inum, name);
+      for (i32 rw = 0; rw < 2; ++rw) {
+        fprintf(fp, "%s_total{inum=\"%d\",file=\"", fileNames[m],
+          top[i].inum);
+        metricsLabel(fp, name);
+        fprintf(fp, "\",rw=\"%s\"} %llu\n", g_metricsRw[rw],
+          (unsigned long long)(m == 0 ? top[i].bytes[rw] : top[i].bio[rw]));
+      }
+    }
+  }
+
+  metricsFamily(fp, "bfs_file_cache_hits", "counter", "cache hits, by file");
+  for (i32 i = 0; i < num; ++i) {
+    char name[FNAMESIZE];
+    statsGetName(top[i].inum, name);
+    fprintf(fp, "bfs_file_cache_hits_total{inum=\"%d\",file=\"", top[i].inum);
+    metricsLabel(fp, name);
+    fprintf(fp, "\"} %llu\n", (unsigned long long)top[i].hits);
+  }
+  metricsFamily(fp, "bfs_file_seconds", "counter",
+    "time spent in fs.h calls, by file");
+  for (i32 i = 0; i < num; ++i) {
+    char name[FNAMESIZE];
+    statsGetName(top[i].inum, name);
+    fprintf(fp, "bfs_file_seconds_total{inum=\"%d\",file=\"", top[i].inum);
+    metricsLabel(fp, name);
+    fprintf(fp, "\"} %.9f\n", top[i].ns / 1e9);
+  }
+
+  fprintf(fp, "# EOF\n");
+  return 0;
+}
+
+
+
+// ============================================================================
+// Write the metrics to 'path', by way of a temporary file renamed over it,
+// so that a scraper never reads half a file.  Return 0, or EBADWRITE
+// ============================================================================
+static i32 metricsFile(str path) {
+  char tmp[FILENAME_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE* fp = fopen(tmp, "w");
+  if (fp == NULL) return EBADWRITE;
+  metricsWrite(fp);
+  i32 bad = ferror(fp);
+  if (fclose(fp) != 0 || bad || rename(tmp, path) != 0) {
+    remove(tmp);
+    return EBADWRITE;
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Answer one connection, 'c', on the metrics socket.  If the peer sent
+// something that looks like an HTTP request, wrap the text in a response.
+// The text is rendered afresh if 'text' is older than the interval
+// ============================================================================
+static void metricsServe(i32 c, str* text, size_t* len, u64* stamp) {
+  char req[512];
+  i32 n = devSockRecv(c, req, sizeof(req) - 1, METRICSSLICEMS);
+  req[n] = 0;
+
+  u64 now = histNow();
+  if (*text == NULL || (now - *stamp) / 1000000 >= (u64)g_metricsMs) {
+    free(*text);
+    *text = NULL;
+    FILE* fp = open_memstream(text, len);
+    if (fp == NULL) FATAL(ENOMEM);
+    metricsWrite(fp);
+    fclose(fp);
+    *stamp = now;
+  }
+
+  if (strncmp(req, "GET ", 4) == 0) {
+    char head[256];
+    i32 h = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: "
+      "application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+      "Content-Length: %zu\r\n\r\n", *len);
+    devSockSend(c, head, h);
+  }
+  devSockSend(c, *text, (i32)*len);
+  devSockClose(c, NULL);
+}
+
+
+
+// ============================================================================
+// Body of the exporter thread.  With a socket, answer connections as they
+// come; with a file, rewrite it every interval.  Either way, check for stop
+// every METRICSSLICEMS
+// ============================================================================
+static void* metricsThread(void* p) {
+  (void)p;
+  str    text  = NULL;
+  size_t len   = 0;
+  u64    stamp = 0;
+  u64    last  = 0;
+
+  while (!atomic_load(&g_metricsStop)) {
+    if (g_metricsSock >= 0) {
+      i32 c = devSockAccept(g_metricsSock, METRICSSLICEMS);
+      if (c >= 0) metricsServe(c, &text, &len, &stamp);
+      continue;
+    }
+    u64 now = histNow();
+    if (last == 0 || (now - last) / 1000000 >= (u64)g_metricsMs) {
+      metricsFile(g_metricsTarget);
+      last = now;
+    }
+    histSleep(METRICSSLICEMS);
+  }
+
+  free(text);
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Start exporting to 'target': a file, rewritten every 'ms' milliseconds,
+// or "unix:PATH", a socket at PATH answered on each connection, with text
+// at most 'ms' milliseconds old.  'ms' of 0 or less means METRICSMS.
+// Return 0, or ENODISK if the socket cannot be made
+// ============================================================================
+i32 metricsStart(str target, i32 ms) {
+  if (target == NULL) FATAL(ENULLPTR);
+  if (g_metricsRun) metricsStop();
+
+  g_metricsTarget = target;
+  g_metricsMs     = (ms > 0) ? ms : METRICSMS;
+  g_metricsSock   = -1;
+  if (strncmp(target, "unix:", 5) == 0) {
+    g_metricsSock = devSockListen(target + 5);
+    if (g_metricsSock < 0) return ENODISK;
+  }
+
+  atomic_store(&g_metricsStop, 0);
+  pthread_create(&g_metricsTid, NULL, metricsThread, NULL);
+  g_metricsRun = 1;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop exporting.  A file is written one last time, so that it holds the
+// final counts; a socket is closed and removed
+// ============================================================================
+i32 metricsStop() {
+  if (!g_metricsRun) return 0;
+  atomic_store(&g_metricsStop, 1);
+  pthread_join(g_metricsTid, NULL);
+  g_metricsRun = 0;
+
+  if (g_metricsSock >= 0) {
+    devSockClose(g_metricsSock, g_metricsTarget + 5);
+    g_metricsSock = -1;
+  } else {
+    metricsFile(g_metricsTarget);
+  }
+  return 0;
+}
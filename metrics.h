@@ -0,0 +1,27 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// ===================================================================
+// metrics.h - OpenMetrics (Prometheus text format) exporter.  Every
+// BFS counter - fs.h calls, bio calls by operation, block class and
+// direction, bytes, backend transfers, cache, Freelist, errors, Open
+// File Table, the per-file counters - and every latency histogram.
+//
+// metricsStart runs a thread that either rewrites a file every
+// 'ms' milliseconds, for a node-local agent to scrape, or, given
+// "unix:PATH", answers each connection on a Unix domain socket with
+// the text, as an HTTP response if the request looks like one
+// ===================================================================
+
+#include <stdio.h>
+#include "alias.h"
+
+#define METRICSMS     15000       // default refresh interval
+#define METRICSMINLE  10          // histogram buckets: 2^10 ns (~1 us)
+#define METRICSMAXLE  34          //   ... to 2^34 ns (~17 s), then +Inf
+
+i32 metricsStart(str target, i32 ms);
+i32 metricsStop ();
+i32 metricsWrite(FILE* fp);
+
+#endif
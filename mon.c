@@ -0,0 +1,285 @@
+// ============================================================================
+// mon.c - live statistics in shared memory, and the bfstop monitor
+// ============================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "dev.h"
+#include "fs.h"
+#include "hist.h"
+#include "mon.h"
+
+typedef struct {                        // MonShm: the shared segment
+  u32         magic;                    // MONMAGIC once first published
+  u32         size;                     // sizeof(MonShm), as built
+  atomic_uint seq;                      // odd while being written
+  u64         start;                    // histNow when publishing began
+  u64         stamp;                    // histNow at the latest publish
+  FsStats     fs;                       // fsGetStats
+  Hist        lat[NUMLAT];              // statsGetHist, every histogram
+  i32         numFiles;                 // entries in 'files'
+  FileStats   files[NUMINODES];         // fsTopFiles
+  char        names[NUMINODES][FNAMESIZE];  // of each of 'files'
+} MonShm;
+
+static MonShm*    g_monShm  = NULL;     // segment being published into
+static str        g_monName = NULL;     // ... and its name
+static pthread_t  g_monTid;
+static atomic_int g_monStop = 0;        // publisher finishes when set
+
+static MonShm     s_monSnap;            // publisher's scratch copy
+static MonShm     s_monCur;             // bfstop: latest snapshot
+static MonShm     s_monPrev;            // bfstop: the one before
+
+
+
+// ============================================================================
+// Gather a snapshot into s_monSnap, then copy it into the segment under
+// its sequence count, so that readers never see half of one
+// ============================================================================
+static void monPublish() {
+  MonShm* s = &s_monSnap;
+  fsGetStats(&s->fs);
+  for (i32 l = 0; l < NUMLAT; ++l) statsGetHist(l, &s->lat[l]);
+  s->numFiles = fsTopFiles(s->files, NUMINODES);
+  for (i32 i = 0; i < s->numFiles; ++i) {
+    statsGetName(s->files[i].inum, s->names[i]);
+  }
+  s->stamp = histNow();
+
+  MonShm* m  = g_monShm;
+  u32     sq = atomic_load_explicit(&m->seq, memory_order_relaxed);
+  atomic_store_explicit(&m->seq, sq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  m->magic    = MONMAGIC;
+  m->size     = sizeof(MonShm);
+  m->start    = s->start;
+  m->stamp    = s->stamp;
+  m->fs       = s->fs;
+  memcpy(m->lat, s->lat, sizeof(m->lat));
+  m->numFiles = s->numFiles;
+  memcpy(m->files, s->files, sizeof(m->files));
+  memcpy(m->names, s->names, sizeof(m->names));
+  atomic_store_explicit(&m->seq, sq + 2, memory_order_release);
+}
+
+
+
+// ============================================================================
+// Body of the publisher thread: publish every MONTICKMS until told to stop
+// ============================================================================
+static void* monThread(void* p) {
+  (void)p;
+  while (!atomic_load(&g_monStop)) {
+    monPublish();
+    histSleep(MONTICKMS);
+  }
+  monPublish();
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Start publishing statistics into shared-memory segment 'name' (eg: "/bfs"),
+// creating it, or taking over one left behind.  Return 0, or ENODISK if the
+// segment cannot be made
+// ============================================================================
+i32 monStart(str name) {
+  if (name == NULL) FATAL(ENULLPTR);
+  if (g_monShm != NULL) monStop();
+
+  g_monShm = devShmMap(name, sizeof(MonShm), 1);
+  if (g_monShm == NULL) return ENODISK;
+  g_monName = name;
+
+  memset(&s_monSnap, 0, sizeof(MonShm));
+  s_monSnap.start = histNow();
+  atomic_store(&g_monStop, 0);
+  pthread_create(&g_monTid, NULL, monThread, NULL);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop publishing, and remove the segment
+// ============================================================================
+i32 monStop() {
+  if (g_monShm == NULL) return 0;
+  atomic_store(&g_monStop, 1);
+  pthread_join(g_monTid, NULL);
+  devShmUnmap(g_monShm, sizeof(MonShm), g_monName);
+  g_monShm  = NULL;
+  g_monName = NULL;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Copy a whole snapshot out of segment 'm' into 'out', retrying while the
+// publisher is part way through one.  Return 0, ENYI if nothing has been
+// published there yet by a BFS built like this one, or ESTALESHM if no
+// whole snapshot could be had for MONSTALEMS: a publisher that died mid
+// publish leaves 'seq' odd for good.  'out' is then not to be used
+// ============================================================================
+static i32 monRead(MonShm* m, MonShm* out) {
+  u64 t0 = histNow();
+  for (;;) {
+    if ((histNow() - t0) / 1000000 > MONSTALEMS) return ESTALESHM;
+    u32 s1 = atomic_load_explicit(&m->seq, memory_order_acquire);
+    if (s1 & 1) { histSleep(1); continue; }
+    memcpy(out, m, sizeof(MonShm));
+    atomic_thread_fence(memory_order_acquire);
+    u32 s2 = atomic_load_explicit(&m->seq, memory_order_relaxed);
+    if (s1 != s2) continue;
+    if (s1 == 0 || out->magic != MONMAGIC || out->size != sizeof(MonShm)) {
+      return ENYI;
+    }
+    return 0;
+  }
+}
+
+
+
+// ============================================================================
+// Return how far counter 'cur' has moved on from 'prev'.  A counter that
+// went backwards was reset, so all of 'cur' is new
+// ============================================================================
+static u64 monDelta(u64 cur, u64 prev) {
+  return (cur >= prev) ? cur - prev : cur;
+}
+
+
+
+// ============================================================================
+// Fill 'd' with the values recorded in 'cur' since 'prev' was taken
+// ============================================================================
+static void monHistDelta(Hist* cur, Hist* prev, Hist* d) {
+  histReset(d);
+  i32 reset = cur->count < prev->count;
+  for (i32 b = 0; b < NUMHISTBINS; ++b) {
+    d->bins[b] = reset ? cur->bins[b] : monDelta(cur->bins[b], prev->bins[b]);
+  }
+  d->count = reset ? cur->count : cur->count - prev->count;
+  d->sum   = reset ? cur->sum   : monDelta(cur->sum, prev->sum);
+  d->max   = cur->max;
+}
+
+
+
+// ============================================================================
+// Print one bfstop frame: what happened between snapshots 'p' and 'c'
+// ============================================================================
+static void monFrame(str name, MonShm* p, MonShm* c, i32 stale) {
+  double secs = monDelta(c->stamp, p->stamp) / 1e9;
+  if (secs <= 0) secs = 1e-9;
+  FsStats* f  = &c->fs;
+  FsStats* pf = &p->fs;
+
+  u64 ops = 0;
+  for (i32 op = 1; op < NUMOPS; ++op) ops += monDelta(f->ops[op], pf->ops[op]);
+  u64 bio  = monDelta(f->bioReads + f->bioWrites,
+                      pf->bioReads + pf->bioWrites);
+  u64 meta = monDelta(f->metaIOs, pf->metaIOs);
+  u64 hits = monDelta(f->cacheHits, pf->cacheHits);
+  u64 look = hits + monDelta(f->cacheMisses, pf->cacheMisses);
+
+  printf("\033[H\033[J");
+  printf("bfstop - %s, up %.1f s%s \n\n", name, (c->stamp - c->start) / 1e9,
+    stale ? "  [STALE: not updating]" : "");
+  printf("ops     %10.0f /s   read %8.2f MB/s   write %8.2f MB/s \n",
+    ops / secs, monDelta(f->bytesRead, pf->bytesRead) / secs / 1e6,
+    monDelta(f->bytesWritten, pf->bytesWritten) / secs / 1e6);
+  printf("bio     %10.0f /s   %.1f%% metadata   device %.0f rd/s %.0f wr/s \n",
+    bio / secs, bio ? 100.0 * meta / bio : 0.0,
+    monDelta(f->devReads, pf->devReads) / secs,
+    monDelta(f->devWrites, pf->devWrites) / secs);
+  if (look > 0) {
+    printf("cache   %9.1f%% hit   %d dirty blocks \n", 100.0 * hits / look,
+      f->dirty);
+  } else {
+    printf("cache   %10s \n", "off");
+  }
+  printf("allocs  %10.0f /s   frees %.0f/s   errors %llu   OFT %d/%d \n\n",
+    monDelta(f->allocs, pf->allocs) / secs,
+    monDelta(f->frees, pf->frees) / secs,
+    (unsigned long long)monDelta(f->errors, pf->errors), f->oftUsed,
+    f->oftSize);
+
+  printf("%-9s %9s %9s %9s %9s %9s  (us) \n", "latency", "calls/s", "p50",
+    "p90", "p99", "p99.9");
+  for (i32 l = 1; l < NUMLAT; ++l) {
+    Hist d;
+    monHistDelta(&c->lat[l], &p->lat[l], &d);
+    if (d.count == 0) continue;
+    printf("%-9s %9.0f %9.1f %9.1f %9.1f %9.1f \n", statsLatName(l),
+      d.count / secs, histPercentile(&d, 50.0) / 1e3,
+      histPercentile(&d, 90.0) / 1e3, histPercentile(&d, 99.0) / 1e3,
+      histPercentile(&d, 99.9) / 1e3);
+  }
+
+  printf("\n%-4s %-15s %9s %9s %9s %9s %6s \n", "inum", "busiest files",
+    "calls/s", "rd MB/s", "wr MB/s", "bio/s", "hit%");
+  for (i32 i = 0; i < c->numFiles; ++i) {
+    FileStats* cf = &c->files[i];
+    FileStats  pz;
+    FileStats* pp = &pz;
+    memset(&pz, 0, sizeof(pz));
+    for (i32 j = 0; j < p->numFiles; ++j) {
+      if (p->files[j].inum == cf->inum) pp = &p->files[j];
+    }
+    u64 calls = 0;
+    for (i32 op = 0; op < NUMOPS; ++op) {
+      calls += monDelta(cf->ops[op], pp->ops[op]);
+    }
+    u64 fh = monDelta(cf->hits, pp->hits);
+    u64 fl = fh + monDelta(cf->misses, pp->misses);
+    printf("%-4d %-15.15s %9.0f %9.2f %9.2f %9.0f %5.1f%% \n", cf->inum,
+      c->names[i][0] ? c->names[i] : "-", calls / secs,
+      monDelta(cf->bytes[IOREAD], pp->bytes[IOREAD]) / secs / 1e6,
+      monDelta(cf->bytes[IOWRITE], pp->bytes[IOWRITE]) / secs / 1e6,
+      monDelta(cf->bio[IOREAD] + cf->bio[IOWRITE],
+               pp->bio[IOREAD] + pp->bio[IOWRITE]) / secs,
+      fl ? 100.0 * fh / fl : 0.0);
+  }
+  printf("\n"); fflush(stdout);
+}
+
+
+
+// ============================================================================
+// bfstop: attach to shared-memory segment 'name' and, every MONTOPMS, show
+// what the BFS instance publishing there did since the frame before.  Stop
+// after 'frames' frames; 0 means run until killed.  Rates are over the time
+// between the two snapshots shown, so they hold even if a publish is late.
+// A segment left part way updated is shown as stale, with the last whole
+// snapshot.  Return 0, ENODISK if there is no such segment, ENYI if nothing
+// has been published into it, or ESTALESHM if it was stuck from the start
+// ============================================================================
+i32 monTop(str name, i32 frames) {
+  if (name == NULL) FATAL(ENULLPTR);
+  MonShm* m = devShmMap(name, sizeof(MonShm), 0);
+  if (m == NULL) return ENODISK;
+
+  i32 ret = monRead(m, &s_monPrev);
+  for (i32 n = 0; ret == 0 && (frames <= 0 || n < frames); ++n) {
+    histSleep(MONTOPMS);
+    ret = monRead(m, &s_monCur);
+    i32 stale = (ret == ESTALESHM);
+    if (stale) {                              // keep the last whole one
+      memcpy(&s_monCur, &s_monPrev, sizeof(MonShm));
+      ret = 0;
+    }
+    if (ret != 0) break;
+    stale |= (histNow() - s_monCur.stamp) / 1000000 > MONSTALEMS;
+    monFrame(name, &s_monPrev, &s_monCur, stale);
+    memcpy(&s_monPrev, &s_monCur, sizeof(MonShm));
+  }
+
+  devShmUnmap(m, sizeof(MonShm), NULL);
+  return ret;
+}
@@ -0,0 +1,26 @@
+#ifndef MON_H
+#define MON_H
+
+// ===================================================================
+// mon.h - live statistics in shared memory.  monStart starts a thread
+// that, every MONTICKMS, copies the counters the accounting already
+// keeps - fsGetStats, the latency histograms, the per-file counters -
+// into a POSIX shared-memory segment.  The fs.h calls pay nothing
+// extra for it.  monTop, behind "a.out bfstop", attaches to that
+// segment from another process and shows what the instance is doing,
+// refreshed every MONTOPMS
+// ===================================================================
+
+#include "alias.h"
+
+#define MONNAME       "/bfs"      // default shared-memory segment
+#define MONMAGIC      0x42465331  // "BFS1"
+#define MONTICKMS     250         // publish interval
+#define MONTOPMS      1000        // bfstop refresh interval
+#define MONSTALEMS    2000        // no publish for this long => stale
+
+i32 monStart(str name);
+i32 monStop ();
+i32 monTop  (str name, i32 frames);
+
+#endif
@@ -0,0 +1,232 @@
+// ============================================================================
+// prof.c - per-layer time attribution, from the CPU cycle counter
+// ============================================================================
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "errors.h"
+#include "hist.h"
+#include "prof.h"
+#include "stats.h"
+
+typedef struct ProfThread {             // one per profiled thread
+  u64 layer[NUMOPS][NUMPROFLAYER];      // cycles by fs.h call and layer
+  u64 cat  [NUMOPS][NUMPROFCAT];        // cycles by fs.h call and purpose
+  u64 calls[NUMOPS];                    // outermost marks, by fs.h call
+  i32 op;                               // fs.h call being charged
+  i32 depth;                            // marks now open
+  u64 last;                             // cycle count at the latest mark
+  i8  frameLayer[PROFDEPTH];            // layer of each open mark
+  i8  frameCat  [PROFDEPTH];            // purpose of each open mark
+  struct ProfThread* next;              // next on g_profThreads
+} ProfThread;
+
+static ProfThread*          g_profThreads = NULL;   // every thread's block
+static u64                  g_profC0      = 0;      // cycles at reset
+static u64                  g_profN0      = 0;      // nanoseconds at reset
+static pthread_mutex_t      g_profLock    = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local ProfThread* t_prof   = NULL;   // this thread's block
+
+static str g_profLayerNames[NUMPROFLAYER] = {
+  "fs", "bfs", "cache", "bio", "dev"
+};
+
+static str g_profCatNames[NUMPROFCAT] = {
+  "other", "meta", "alloc", "data-io", "memcpy"
+};
+
+
+
+// ============================================================================
+// Return the CPU cycle counter: the TSC on x86, the virtual counter on ARM.
+// Elsewhere, fall back on the clock, in nanoseconds
+// ============================================================================
+static inline u64 profCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  u64 v;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#else
+  return histNow();
+#endif
+}
+
+
+
+// ============================================================================
+// Return this thread's counters, creating and registering them on first use
+// ============================================================================
+static ProfThread* profThread() {
+  if (t_prof != NULL) return t_prof;
+
+  ProfThread* t = calloc(1, sizeof(ProfThread));
+  if (t == NULL) FATAL(ENOMEM);
+
+  pthread_mutex_lock(&g_profLock);
+  if (g_profC0 == 0) {
+    g_profC0 = profCycles();
+    g_profN0 = histNow();
+  }
+  t->next = g_profThreads;
+  g_profThreads = t;
+  pthread_mutex_unlock(&g_profLock);
+
+  t_prof = t;
+  return t;
+}
+
+
+
+// ============================================================================
+// Charge the cycles since the latest mark to the innermost open mark
+// ============================================================================
+static void profCharge(ProfThread* t, u64 now) {
+  i32 top = ((t->depth < PROFDEPTH) ? t->depth : PROFDEPTH) - 1;
+  if (top < 0) return;
+  u64 n = now - t->last;
+  t->layer[t->op][(i32)t->frameLayer[top]] += n;
+  t->cat  [t->op][(i32)t->frameCat  [top]] += n;
+}
+
+
+
+// ============================================================================
+// Print one row of 'num' cycle counts, 'v', as shares of their total
+// ============================================================================
+static void profShares(u64* v, i32 num) {
+  u64 total = 0;
+  for (i32 i = 0; i < num; ++i) total += v[i];
+  for (i32 i = 0; i < num; ++i) {
+    printf(" %7.1f%%", total ? 100.0 * v[i] / total : 0.0);
+  }
+  printf(" \n");
+}
+
+
+
+// ============================================================================
+// Print, for every fs.h call made since profReset, its mean time, and how
+// that time splits by purpose and by layer.  Time spent in bio calls made
+// outside any fs.h call shows as "none".  Return ENYI, printing nothing, if
+// BFS was compiled without BFSPROF
+// ============================================================================
+i32 profDump() {
+#ifndef BFSPROF
+  return ENYI;
+#endif
+  u64 layer[NUMOPS][NUMPROFLAYER];
+  u64 cat  [NUMOPS][NUMPROFCAT];
+  u64 calls[NUMOPS];
+  memset(layer, 0, sizeof(layer));
+  memset(cat,   0, sizeof(cat));
+  memset(calls, 0, sizeof(calls));
+
+  pthread_mutex_lock(&g_profLock);
+  for (ProfThread* t = g_profThreads; t != NULL; t = t->next) {
+    for (i32 op = 0; op < NUMOPS; ++op) {
+      calls[op] += t->calls[op];
+      for (i32 l = 0; l < NUMPROFLAYER; ++l) layer[op][l] += t->layer[op][l];
+      for (i32 c = 0; c < NUMPROFCAT;   ++c) cat  [op][c] += t->cat  [op][c];
+    }
+  }
+  double nsPerCycle = (double)(histNow() - g_profN0) /
+                      (double)(profCycles() - g_profC0 + 1);
+  pthread_mutex_unlock(&g_profLock);
+
+  printf("\n%-8s %8s %12s %10s", "call", "calls", "cycles/call", "ns/call");
+  for (i32 c = 0; c < NUMPROFCAT; ++c) printf(" %8s", g_profCatNames[c]);
+  printf(" \n");
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    if (calls[op] == 0) continue;
+    u64 total = 0;
+    for (i32 c = 0; c < NUMPROFCAT; ++c) total += cat[op][c];
+    printf("%-8s %8llu %12.0f %10.0f", statsOpName(op),
+      (unsigned long long)calls[op], (double)total / calls[op],
+      nsPerCycle * total / calls[op]);
+    profShares(cat[op], NUMPROFCAT);
+  }
+
+  printf("\n%-8s", "call");
+  for (i32 l = 0; l < NUMPROFLAYER; ++l) printf(" %8s", g_profLayerNames[l]);
+  printf(" \n");
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    if (calls[op] == 0) continue;
+    printf("%-8s", statsOpName(op));
+    profShares(layer[op], NUMPROFLAYER);
+  }
+  printf("(by purpose of the innermost region that has one; by layer, self "
+    "time; %.3f ns/cycle) \n\n", nsPerCycle);
+  fflush(stdout);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Mark entry to a function of layer 'layer', one of the PROFxxx layers,
+// whose purpose is 'cat': a PROFxxx purpose, or PROFSAME to keep that of
+// the caller.  An outermost mark takes the fs.h call running, if any, as
+// the one to charge
+// ============================================================================
+i32 profEnter(i32 layer, i32 cat) {
+  ProfThread* t = profThread();
+  u64 now = profCycles();
+
+  if (t->depth == 0) {
+    t->op = statsOp();
+    ++t->calls[t->op];
+  } else {
+    profCharge(t, now);
+  }
+  t->last = now;
+
+  if (t->depth < PROFDEPTH) {
+    i32 parent = (t->depth > 0) ? t->frameCat[t->depth - 1] : PROFOTHER;
+    t->frameLayer[t->depth] = layer;
+    t->frameCat  [t->depth] = (cat == PROFSAME) ? parent : cat;
+  }
+  ++t->depth;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Mark exit from the function marked by the matching profEnter
+// ============================================================================
+i32 profLeave() {
+  ProfThread* t = t_prof;
+  if (t == NULL || t->depth == 0) return 0;
+  u64 now = profCycles();
+  profCharge(t, now);
+  t->last = now;
+  --t->depth;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Zero every thread's counters.  Call between fs.h calls, not during them
+// ============================================================================
+i32 profReset() {
+  pthread_mutex_lock(&g_profLock);
+  for (ProfThread* t = g_profThreads; t != NULL; t = t->next) {
+    memset(t->layer, 0, sizeof(t->layer));
+    memset(t->cat,   0, sizeof(t->cat));
+    memset(t->calls, 0, sizeof(t->calls));
+  }
+  g_profC0 = profCycles();
+  g_profN0 = histNow();
+  pthread_mutex_unlock(&g_profLock);
+  return 0;
+}
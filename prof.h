@@ -0,0 +1,54 @@
+#ifndef PROF_H
+#define PROF_H
+
+// ===================================================================
+// prof.h - per-layer time attribution.  Each layer - fs, bfs, block
+// cache, bio, backend - marks entry and exit of its functions with
+// PROFENTER and PROFLEAVE, which read the CPU cycle counter.  Every
+// stretch of cycles between two marks is charged to the fs.h call
+// running, twice over: to the layer that was innermost, and to the
+// purpose - metadata lookup, allocation, data I/O, memcpy - of the
+// innermost region that has one.  profDump reports both splits
+//
+// The marks exist only when BFS is compiled with -DBFSPROF.  Without
+// it, PROFENTER and PROFLEAVE expand to nothing and profDump returns
+// ENYI
+// ===================================================================
+
+#include "alias.h"
+
+#define PROFFS        0           // Layers: fs.h calls
+#define PROFBFS       1           //   bfs.c
+#define PROFCACHE     2           //   block cache in bio.c
+#define PROFBIO       3           //   bioRead and bioWrite
+#define PROFDEV       4           //   the bio backend
+#define NUMPROFLAYER  5
+
+#define PROFSAME      -1          // Purposes: that of the enclosing region
+#define PROFOTHER     0           //   none of the below
+#define PROFMETA      1           //   Directory, Inode and block map lookups
+#define PROFALLOC     2           //   Freelist allocation and release
+#define PROFDATA      3           //   bio calls on file data
+#define PROFCOPY      4           //   memcpy between user and block buffers
+#define NUMPROFCAT    5
+
+#define PROFDEPTH     32          // nesting tracked; deeper marks are merged
+
+#ifdef BFSPROF
+
+#define PROFENTER(layer, cat) profEnter(layer, cat)
+#define PROFLEAVE()           profLeave()
+
+#else
+
+#define PROFENTER(layer, cat) ((void)0)
+#define PROFLEAVE()           ((void)0)
+
+#endif
+
+i32 profDump ();
+i32 profEnter(i32 layer, i32 cat);
+i32 profLeave();
+i32 profReset();
+
+#endif
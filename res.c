@@ -0,0 +1,319 @@
+// ============================================================================
+// res.c - machine-readable benchmark results, and comparison of two runs
+// ============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysinfo.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#include "errors.h"
+#include "res.h"
+
+typedef struct {                  // ResSet: a growable array of samples
+  ResSample* s;
+  i32 num;
+  i32 cap;
+} ResSet;
+
+typedef struct {                  // ResSummary: the samples of one metric
+  i32    n;
+  double mean;
+  double sd;                      // sample standard deviation
+} ResSummary;
+
+static ResSet g_res = { NULL, 0, 0 };   // samples added by this process
+
+// Two-sided 95% critical values of Student's t, for 1..30 degrees of freedom
+
+static double g_resT95[31] = { 0.0,
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+
+
+// ============================================================================
+// Append 'x' to set 'set'
+// ============================================================================
+static void resPush(ResSet* set, ResSample* x) {
+  if (set->num == set->cap) {
+    set->cap = (set->cap == 0) ? 256 : set->cap * 2;
+    set->s   = realloc(set->s, set->cap * sizeof(ResSample));
+    if (set->s == NULL) FATAL(ENOMEM);
+  }
+  set->s[set->num++] = *x;
+}
+
+
+
+// ============================================================================
+// Return the square root of 'x', by Newton's method.  BFS builds without
+// libm
+// ============================================================================
+static double resSqrt(double x) {
+  if (x <= 0.0) return 0.0;
+  double r = (x > 1.0) ? x : 1.0;
+  for (i32 i = 0; i < 100; ++i) {
+    double next = 0.5 * (r + x / r);
+    if (next >= r) break;
+    r = next;
+  }
+  return r;
+}
+
+
+
+// ============================================================================
+// Return 1 if samples 'a' and 'b' measure the same thing
+// ============================================================================
+static i32 resSameKey(ResSample* a, ResSample* b) {
+  return strcmp(a->bench,  b->bench)  == 0 &&
+         strcmp(a->config, b->config) == 0 &&
+         strcmp(a->metric, b->metric) == 0;
+}
+
+
+
+// ============================================================================
+// Record one measurement 'value' of 'metric', for benchmark 'bench' run in
+// configuration 'config'.  'better' is RESLOWER or RESHIGHER.  Adding the
+// same metric again records the next repetition
+// ============================================================================
+i32 resAdd(str bench, str config, str metric, i32 better, double value) {
+  if (bench == NULL || config == NULL || metric == NULL) FATAL(ENULLPTR);
+
+  ResSample x;
+  memset(&x, 0, sizeof(ResSample));
+  snprintf(x.bench,  RESNAMESIZE, "%s", bench);
+  snprintf(x.config, RESNAMESIZE, "%s", config);
+  snprintf(x.metric, RESNAMESIZE, "%s", metric);
+  x.better = better;
+  x.value  = value;
+
+  for (i32 i = 0; i < g_res.num; ++i) {
+    if (resSameKey(&g_res.s[i], &x)) ++x.rep;
+  }
+  resPush(&g_res, &x);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Forget every sample added so far
+// ============================================================================
+i32 resClear() {
+  free(g_res.s);
+  g_res.s   = NULL;
+  g_res.num = g_res.cap = 0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read the samples in results file 'path', written by resWrite as CSV or
+// JSON, into 'set'.  Both formats keep one sample per line
+// ============================================================================
+static void resLoad(str path, ResSet* set) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) FATAL(ENODISK);
+
+  char line[512];
+  char better[RESNAMESIZE];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    ResSample x;
+    memset(&x, 0, sizeof(ResSample));
+    i32 n = sscanf(line, " {\"bench\": \"%23[^\"]\", "
+      "\"config\": \"%23[^\"]\", \"metric\": \"%23[^\"]\", "
+      "\"better\": \"%23[^\"]\", \"rep\": %d, "
+      "\"value\": %lf", x.bench, x.config, x.metric, better, &x.rep,
+      &x.value);
+    if (n != 6) {
+      n = sscanf(line, "%23[^,],%23[^,],%23[^,],%23[^,],%d,%lf", x.bench,
+        x.config, x.metric, better, &x.rep, &x.value);
+    }
+    if (n != 6 || x.bench[0] == '#') continue;  // metadata, header, braces
+    x.better = (strcmp(better, "higher") == 0) ? RESHIGHER : RESLOWER;
+    resPush(set, &x);
+  }
+  fclose(fp);
+}
+
+
+
+// ============================================================================
+// Summarize the samples in 'set' that measure the same thing as 'key'
+// ============================================================================
+static ResSummary resSummarize(ResSet* set, ResSample* key) {
+  ResSummary sum = { 0, 0.0, 0.0 };
+  double m2 = 0.0;                              // Welford's running variance
+  for (i32 i = 0; i < set->num; ++i) {
+    if (!resSameKey(&set->s[i], key)) continue;
+    double d = set->s[i].value - sum.mean;
+    ++sum.n;
+    sum.mean += d / sum.n;
+    m2 += d * (set->s[i].value - sum.mean);
+  }
+  sum.sd = (sum.n > 1) ? resSqrt(m2 / (sum.n - 1)) : 0.0;
+  return sum;
+}
+
+
+
+// ============================================================================
+// Return the 95% critical value of Student's t for 'df' degrees of freedom
+// ============================================================================
+static double resT95(double df) {
+  if (df < 1.0)  return g_resT95[1];
+  if (df > 30.0) return 1.96;
+  return g_resT95[(i32)df];
+}
+
+
+
+// ============================================================================
+// Compare the results in 'curPath' against the baseline in 'basePath'.  For
+// every metric in both, print the mean of each and the change, with a 95%
+// confidence interval on the change from Welch's t-test.  A change whose
+// interval excludes zero is flagged: "WORSE" or "better".  A metric run
+// fewer than twice in either file gets no interval and is never flagged.
+// Return the number of metrics that got WORSE
+// ============================================================================
+i32 resCompare(str basePath, str curPath) {
+  if (basePath == NULL || curPath == NULL) FATAL(ENULLPTR);
+
+  ResSet base = { NULL, 0, 0 };
+  ResSet cur  = { NULL, 0, 0 };
+  resLoad(basePath, &base);
+  resLoad(curPath,  &cur);
+
+  printf("\n%-10s %-12s %-12s %12s %12s %9s %9s %s \n", "bench", "config",
+    "metric", "baseline", "current", "change", "+/-", "verdict");
+
+  i32 worse = 0;
+  for (i32 i = 0; i < cur.num; ++i) {
+    ResSample* key = &cur.s[i];
+    if (key->rep != 0) continue;                // one row per metric
+
+    ResSummary b = resSummarize(&base, key);
+    ResSummary c = resSummarize(&cur,  key);
+    if (b.n == 0) continue;
+
+    double diff  = c.mean - b.mean;
+    double scale = (b.mean < 0.0) ? -b.mean : b.mean;
+    double pct   = (scale > 0.0) ? 100.0 * diff / scale : 0.0;
+
+    str    verdict = "n<2";
+    double ci      = 0.0;
+    if (b.n > 1 && c.n > 1) {
+      double vb = b.sd * b.sd / b.n;
+      double vc = c.sd * c.sd / c.n;
+      double se = resSqrt(vb + vc);
+      double df = (vb + vc) * (vb + vc) /
+        (vb * vb / (b.n - 1) + vc * vc / (c.n - 1) + 1e-300);
+      ci = resT95(df) * se;
+
+      verdict = "same";
+      if ((diff < 0.0 ? -diff : diff) > ci) {
+        i32 up = (diff > 0.0);
+        i32 bad = (key->better == RESLOWER) ? up : !up;
+        verdict = bad ? "WORSE" : "better";
+        if (bad) ++worse;
+      }
+    }
+
+    printf("%-10s %-12s %-12s %12.3f %12.3f %8.1f%% %8.1f%% %s \n",
+      key->bench, key->config, key->metric, b.mean, c.mean, pct,
+      (scale > 0.0) ? 100.0 * ci / scale : 0.0, verdict);
+  }
+  printf("%d metric(s) worse \n\n", worse); fflush(stdout);
+
+  free(base.s);
+  free(cur.s);
+  return worse;
+}
+
+
+
+// ============================================================================
+// Write one "key, value" line of metadata about this machine and build, in
+// the style 'json' selects
+// ============================================================================
+static void resEnv(FILE* fp, i32 json, str key, str value, i32 last) {
+  if (json) fprintf(fp, "    \"%s\": \"%s\"%s\n", key, value, last ? "" : ",");
+  else      fprintf(fp, "# %s: %s\n", key, value);
+}
+
+
+
+// ============================================================================
+// Save every sample added so far into 'path', as JSON if 'path' ends in
+// ".json", otherwise as CSV.  Either way the file starts with a description
+// of the machine and build that produced it
+// ============================================================================
+i32 resWrite(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  size_t len  = strlen(path);
+  i32    json = (len >= 5 && strcmp(path + len - 5, ".json") == 0);
+
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) FATAL(EDISKCREATE);
+
+  struct utsname un;
+  if (uname(&un) != 0) memset(&un, 0, sizeof(un));
+
+  char when[32];
+  time_t now = time(NULL);
+  strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  char cpus[16];
+  snprintf(cpus, sizeof(cpus), "%d", get_nprocs());
+
+#ifdef BFSHOOKS
+  str hooks = "on";
+#else
+  str hooks = "off";
+#endif
+#ifdef BFSPROF
+  str prof = "on";
+#else
+  str prof = "off";
+#endif
+
+  if (json) fprintf(fp, "{\n  \"env\": {\n");
+  resEnv(fp, json, "host",     un.nodename, 0);
+  resEnv(fp, json, "os",       un.sysname,  0);
+  resEnv(fp, json, "release",  un.release,  0);
+  resEnv(fp, json, "machine",  un.machine,  0);
+  resEnv(fp, json, "cpus",     cpus,        0);
+  resEnv(fp, json, "compiler", __VERSION__, 0);
+  resEnv(fp, json, "hooks",    hooks,       0);
+  resEnv(fp, json, "prof",     prof,        0);
+  resEnv(fp, json, "date",     when,        1);
+
+  if (json) fprintf(fp, "  },\n  \"samples\": [\n");
+  else      fprintf(fp, "bench,config,metric,better,rep,value\n");
+
+  for (i32 i = 0; i < g_res.num; ++i) {
+    ResSample* x = &g_res.s[i];
+    str better = (x->better == RESHIGHER) ? "higher" : "lower";
+    if (json) {
+      fprintf(fp, "    {\"bench\": \"%s\", \"config\": \"%s\", \"metric\": "
+        "\"%s\", \"better\": \"%s\", \"rep\": %d, \"value\": %.6g}%s\n",
+        x->bench, x->config, x->metric, better, x->rep, x->value,
+        (i == g_res.num - 1) ? "" : ",");
+    } else {
+      fprintf(fp, "%s,%s,%s,%s,%d,%.6g\n", x->bench, x->config, x->metric,
+        better, x->rep, x->value);
+    }
+  }
+
+  if (json) fprintf(fp, "  ]\n}\n");
+  fclose(fp);
+  return 0;
+}
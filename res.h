@@ -0,0 +1,32 @@
+#ifndef RES_H
+#define RES_H
+
+// ===================================================================
+// res.h - machine-readable benchmark results.  Benchmarks add one
+// sample per metric per run; resWrite saves them, with a description
+// of the machine and build, as CSV or JSON.  resCompare reads two
+// such files and flags metrics whose change is significant, from the
+// spread of the repeated runs in each
+// ===================================================================
+
+#include "alias.h"
+
+#define RESLOWER      0           // lower values are better
+#define RESHIGHER     1           // higher values are better
+#define RESNAMESIZE   24          // bench, config and metric names
+
+typedef struct {                  // ResSample: one measurement
+  char   bench [RESNAMESIZE];     // eg: "backends"
+  char   config[RESNAMESIZE];     // eg: "pread/16"
+  char   metric[RESNAMESIZE];     // eg: "seqwr-us"
+  i32    better;                  // RESLOWER or RESHIGHER
+  i32    rep;                     // 0 for the first run, 1 for the next...
+  double value;
+} ResSample;
+
+i32 resAdd    (str bench, str config, str metric, i32 better, double value);
+i32 resClear  ();
+i32 resCompare(str basePath, str curPath);
+i32 resWrite  (str path);
+
+#endif
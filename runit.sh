@@ -5,3 +5,6 @@ rm -f a.out
 gcc -Wall -Wextra -Wno-sign-compare *.c
 
 ./a.out
+
+./a.out iotest || exit 1
+./a.out fscktest || exit 1
@@ -0,0 +1,296 @@
+// ============================================================================
+// sim.c - offline block cache simulator producing miss-ratio curves
+// ============================================================================
+
+#include "bfs.h"
+#include "blk.h"
+#include "sim.h"
+
+typedef struct {                    // SimList: doubly linked list of DBNs
+  i32 head;                         // most recently inserted; -1 => empty
+  i32 tail;                         // least recently inserted
+  i32 n;                            // # DBNs in the list
+} SimList;
+
+// A DBN is on at most one list at a time, so links are indexed by DBN
+
+static i32 s_prev [SIMMAXDBN];
+static i32 s_next [SIMMAXDBN];
+static i8  s_where[SIMMAXDBN];      // which list holds the DBN; 0 => none
+
+static str g_simNames[NUMSIM] = { "LRU", "CLOCK", "2Q", "ARC" };
+
+
+
+// ============================================================================
+// Empty list 'l', and forget which list every DBN was on
+// ============================================================================
+static void simInit(SimList* l, i32 num) {
+  for (i32 i = 0; i < num; ++i) { l[i].head = l[i].tail = -1; l[i].n = 0; }
+  memset(s_where, 0, sizeof(s_where));
+}
+
+
+
+// ============================================================================
+// Insert 'x' at the head of list 'l', whose id is 'id'
+// ============================================================================
+static void simPush(SimList* l, i32 id, i32 x) {
+  s_prev[x] = -1;
+  s_next[x] = l->head;
+  if (l->head >= 0) s_prev[l->head] = x; else l->tail = x;
+  l->head = x;
+  s_where[x] = (i8)id;
+  ++l->n;
+}
+
+
+
+// ============================================================================
+// Unlink 'x' from list 'l'
+// ============================================================================
+static void simRemove(SimList* l, i32 x) {
+  if (s_prev[x] >= 0) s_next[s_prev[x]] = s_next[x]; else l->head = s_next[x];
+  if (s_next[x] >= 0) s_prev[s_next[x]] = s_prev[x]; else l->tail = s_prev[x];
+  s_where[x] = 0;
+  --l->n;
+}
+
+
+
+// ============================================================================
+// Unlink and return the tail of list 'l'; -1 if empty
+// ============================================================================
+static i32 simPop(SimList* l) {
+  i32 x = l->tail;
+  if (x >= 0) simRemove(l, x);
+  return x;
+}
+
+
+
+// ============================================================================
+// LRU miss counts for every cache size at once (Mattson's stack algorithm).
+// The reuse distance of an access is the number of distinct DBNs touched
+// since the previous access to the same DBN; it hits in an LRU cache of
+// more than that many blocks.  Distances are counted with a Fenwick tree
+// over access times, marking only the latest access of each DBN.  On return
+// dist[d] is # accesses at distance d, and the result is # cold misses
+// ============================================================================
+static i64 simLruDistances(i32* dbns, i64 num, u64* dist) {
+  i32* tree = calloc(num + 1, sizeof(i32));
+  i64* last = malloc(SIMMAXDBN * sizeof(i64));
+  if (tree == NULL || last == NULL) FATAL(ENOMEM);
+  for (i32 d = 0; d < SIMMAXDBN; ++d) last[d] = -1;
+
+  i64 cold = 0;
+  for (i64 t = 0; t < num; ++t) {
+    i32 x = dbns[t];
+    i64 p = last[x];
+    if (p < 0) {
+      ++cold;
+    } else {
+      i64 after = 0;                          // marks in (p, t)
+      for (i64 i = t; i > 0; i -= i & -i)     after += tree[i];
+      for (i64 i = p + 1; i > 0; i -= i & -i) after -= tree[i];
+      ++dist[after];
+      for (i64 i = p + 1; i <= num; i += i & -i) --tree[i];
+    }
+    for (i64 i = t + 1; i <= num; i += i & -i) ++tree[i];
+    last[x] = t;
+  }
+
+  free(tree);
+  free(last);
+  return cold;
+}
+
+
+
+// ============================================================================
+// Read the bio trace 'path' in issue order, keep the DBNs that SHARDS
+// sampling at 'rate' selects, and print LRU, CLOCK, 2Q and ARC miss ratios
+// for cache sizes from one block up past the number of distinct blocks
+// touched.  LRU is computed for all sizes in one pass; the other policies
+// are simulated per size
+// ============================================================================
+i32 simMissRatios(str path, double rate) {
+  if (path == NULL) FATAL(ENULLPTR);
+  if (rate <= 0.0 || rate > 1.0) rate = 1.0;
+
+  i64       all;
+  BlkEvent* ev = blkLoad(path, &all);         // in issue order
+  i64       num = 0;
+  i32*      dbns = malloc((all > 0 ? all : 1) * sizeof(i32));
+  if (dbns == NULL) FATAL(ENOMEM);
+
+  u32 threshold = (u32)(rate * 0x10000);
+  for (i64 e = 0; e < all; ++e) {
+    if (ev[e].dbn < 0 || ev[e].dbn >= SIMMAXDBN) continue;
+
+    u32 h = (u32)ev[e].dbn * 2654435761u;     // spatial hash for SHARDS
+    h ^= h >> 16;
+    if ((h & 0xFFFF) >= threshold) continue;
+
+    dbns[num++] = ev[e].dbn;
+  }
+  free(ev);
+
+  u64* dist = calloc(SIMMAXDBN + 1, sizeof(u64));
+  if (dist == NULL) FATAL(ENOMEM);
+  i64 cold = simLruDistances(dbns, num, dist);
+
+  printf("\n%s: %lld accesses, %lld sampled (rate %.4f), ~%.0f distinct "
+    "blocks \n", path, (long long)all, (long long)num, rate, cold / rate);
+  printf("%8s", "blocks");
+  for (i32 p = 0; p < NUMSIM; ++p) printf(" %7s", g_simNames[p]);
+  printf("   (miss ratio %%) \n");
+
+  i64 maxSize = (i64)(cold / rate) * 2;
+  for (i64 size = 1; num > 0; size *= 2) {
+    i32 scaled = (i32)(size * rate + 0.5);
+    if (scaled < 1) scaled = 1;
+
+    u64 lruMiss = cold;                       // distance >= scaled => miss
+    for (i64 d = scaled; d <= SIMMAXDBN; ++d) lruMiss += dist[d];
+
+    printf("%8lld %7.2f", (long long)size, 100.0 * lruMiss / num);
+    for (i32 p = SIMCLOCK; p < NUMSIM; ++p) {
+      printf(" %7.2f", 100.0 * simRun(p, dbns, num, scaled) / num);
+    }
+    printf("\n");
+
+    if (size >= maxSize || scaled > SIMMAXDBN) break;
+  }
+  printf("\n"); fflush(stdout);
+
+  free(dist);
+  free(dbns);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Run 'num' accesses 'dbns' through a cache of 'size' blocks managed by
+// 'policy'.  Return the number of misses
+// ============================================================================
+i64 simRun(i32 policy, i32* dbns, i64 num, i32 size) {
+  SimList l[4];
+  simInit(l, 4);
+  i64 misses = 0;
+
+  if (policy == SIMLRU) {                     // l[0]: MRU at head
+    for (i64 t = 0; t < num; ++t) {
+      i32 x = dbns[t];
+      if (s_where[x]) { simRemove(&l[0], x); simPush(&l[0], 1, x); continue; }
+      ++misses;
+      if (l[0].n >= size) simPop(&l[0]);
+      simPush(&l[0], 1, x);
+    }
+
+  } else if (policy == SIMCLOCK) {            // frames swept by a hand
+    i32* frame = malloc(size * sizeof(i32));
+    i8*  ref   = calloc(size, 1);
+    i32* slot  = malloc(SIMMAXDBN * sizeof(i32));
+    if (frame == NULL || ref == NULL || slot == NULL) FATAL(ENOMEM);
+    for (i32 d = 0; d < SIMMAXDBN; ++d) slot[d] = -1;
+
+    i32 used = 0;
+    i32 hand = 0;
+    for (i64 t = 0; t < num; ++t) {
+      i32 x = dbns[t];
+      if (slot[x] >= 0) { ref[slot[x]] = 1; continue; }
+      ++misses;
+      i32 f;
+      if (used < size) {
+        f = used++;
+      } else {
+        while (ref[hand]) { ref[hand] = 0; hand = (hand + 1) % size; }
+        f = hand;
+        slot[frame[f]] = -1;
+        hand = (hand + 1) % size;
+      }
+      frame[f] = x;
+      ref[f]   = 1;
+      slot[x]  = f;
+    }
+    free(frame);
+    free(ref);
+    free(slot);
+
+  } else if (policy == SIM2Q) {               // l[0] A1in, l[1] A1out, l[2] Am
+    i32 kin  = (size / 4 > 0) ? size / 4 : 1;
+    i32 kout = (size / 2 > 0) ? size / 2 : 1;
+    for (i64 t = 0; t < num; ++t) {
+      i32 x = dbns[t];
+      if (s_where[x] == 3) {                  // hit in Am: to its MRU end
+        simRemove(&l[2], x);
+        simPush(&l[2], 3, x);
+        continue;
+      }
+      if (s_where[x] == 1) continue;
+      ++misses;
+
+      i32 ghost = (s_where[x] == 2);
+      if (ghost) simRemove(&l[1], x);
+
+      if (l[0].n + l[2].n >= size) {          // reclaim a frame
+        if (l[0].n > kin || l[2].n == 0) {
+          i32 y = simPop(&l[0]);
+          simPush(&l[1], 2, y);
+          if (l[1].n > kout) simPop(&l[1]);
+        } else {
+          simPop(&l[2]);
+        }
+      }
+      if (ghost) simPush(&l[2], 3, x);
+      else       simPush(&l[0], 1, x);
+    }
+
+  } else if (policy == SIMARC) {    // l[0] T1, l[1] T2, l[2] B1, l[3] B2
+    double p = 0.0;                           // target size of T1
+    for (i64 t = 0; t < num; ++t) {
+      i32 x = dbns[t];
+      i32 w = s_where[x];
+
+      if (w == 1 || w == 2) {                 // hit: move to MRU of T2
+        simRemove(&l[w - 1], x);
+        simPush(&l[1], 2, x);
+        continue;
+      }
+      ++misses;
+
+      if (w == 3) {                           // ghost hit in B1: favor T1
+        double delta = (l[2].n >= l[3].n) ? 1.0 : (double)l[3].n / l[2].n;
+        p = (p + delta > size) ? size : p + delta;
+        simRemove(&l[2], x);
+      } else if (w == 4) {                    // ghost hit in B2: favor T2
+        double delta = (l[3].n >= l[2].n) ? 1.0 : (double)l[2].n / l[3].n;
+        p = (p - delta < 0.0) ? 0.0 : p - delta;
+        simRemove(&l[3], x);
+      } else if (l[0].n + l[2].n >= size) {   // new, and L1 is full
+        if (l[0].n < size) { simPop(&l[2]); }
+        else               { simPop(&l[0]); simPush(&l[0], 1, x); continue; }
+      } else if (l[0].n + l[1].n + l[2].n + l[3].n >= size) {
+        if (l[0].n + l[1].n + l[2].n + l[3].n >= 2 * size) simPop(&l[3]);
+      }
+
+      // REPLACE: make room in T1 + T2 if the cache is full
+
+      if (l[0].n + l[1].n >= size) {
+        if (l[0].n > 0 &&
+            (l[1].n == 0 || l[0].n > p || (w == 4 && l[0].n == (i32)p))) {
+          simPush(&l[2], 3, simPop(&l[0]));
+        } else {
+          simPush(&l[3], 4, simPop(&l[1]));
+        }
+      }
+
+      if (w == 3 || w == 4) simPush(&l[1], 2, x);
+      else                  simPush(&l[0], 1, x);
+    }
+  }
+
+  return misses;
+}
@@ -0,0 +1,24 @@
+#ifndef SIM_H
+#define SIM_H
+
+// ===================================================================
+// sim.h - offline block cache simulator.  Replays the DBNs of a bio
+// trace (see blk.h) through simulated LRU, CLOCK, 2Q and ARC caches
+// and prints miss-ratio curves.  With a sampling rate below 1, only
+// the DBNs whose hash falls under the rate are simulated, with cache
+// sizes scaled to match (SHARDS)
+// ===================================================================
+
+#include "alias.h"
+
+#define SIMMAXDBN     65536       // DBNs are i16, so this bounds them
+#define SIMLRU        0           // Policies
+#define SIMCLOCK      1
+#define SIM2Q         2
+#define SIMARC        3
+#define NUMSIM        4
+
+i32 simMissRatios(str path, double rate);
+i64 simRun       (i32 policy, i32* dbns, i64 num, i32 size);
+
+#endif
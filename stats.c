@@ -0,0 +1,579 @@
+// ============================================================================
+// stats.c - I/O accounting and latency histograms for BFS
+// ============================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "prof.h"
+#include "stats.h"
+
+// A thread's counters are bumped only by that thread, but summed by others
+// meanwhile, so both sides use relaxed atomics: on the hardware this runs
+// on, no dearer than a plain load and store
+#define STATSADD(c, n) __atomic_store_n(&(c), (c) + (n), __ATOMIC_RELAXED)
+#define STATSGET(c)    __atomic_load_n(&(c), __ATOMIC_RELAXED)
+
+typedef struct StatsThread {        // one per recording thread
+  IOStats io;                       // bio counters
+  Hist    lat[NUMLAT];              // latency histograms
+  u64     heat[BLOCKSPERDISK][2];   // bio calls per DBN, IOREAD/IOWRITE
+  FileStats file[NUMINODES];        // per-file counters, by inum
+  i32     op;                       // fs.h operation now executing
+  i32     inum;                     // file 'op' works on, or -1
+  i32     hint;                     // class of the next bio call, or -1
+  u64     t0;                       // start time of 'op'
+  atomic_uint epoch;                // g_statsEpoch its counters belong to
+  struct StatsThread* next;         // next on g_statsThreads
+} StatsThread;
+
+static StatsThread*          g_statsThreads = NULL;   // every thread's block
+static u64                   g_statsT0      = 0;      // start of counting
+static atomic_uint           g_statsEpoch   = 0;      // bumped by statsReset
+static pthread_mutex_t       g_statsLock    = PTHREAD_MUTEX_INITIALIZER;
+static char g_statsNames[NUMINODES][FNAMESIZE];       // see statsName
+static _Thread_local StatsThread* t_stats   = NULL;   // this thread's block
+
+static str g_opNames[NUMOPS] = {
+  "none", "open", "create", "read", "write", "seek",
+  "close", "size", "tell", "format", "mount", "delete"
+};
+
+static str g_bcNames[NUMBC] = {
+  "super", "inode", "dir", "indirect", "data", "free"
+};
+
+
+
+// ============================================================================
+// Zero the 'num' counters at 'c'
+// ============================================================================
+static void statsZero(u64* c, i32 num) {
+  for (i32 i = 0; i < num; ++i) __atomic_store_n(&c[i], 0, __ATOMIC_RELAXED);
+}
+
+
+
+// ============================================================================
+// Zero the counters of file 'f'
+// ============================================================================
+static void statsZeroFile(FileStats* f) {
+  statsZero(f->ops,   NUMOPS);
+  statsZero(f->bytes, 2);
+  statsZero(f->bio,   2);
+  statsZero(&f->hits,   1);
+  statsZero(&f->misses, 1);
+  statsZero(&f->ns,     1);
+}
+
+
+
+// ============================================================================
+// Return whether the counters of 't' are current: not left over from before
+// the latest statsReset.  Readers leave out those that are not
+// ============================================================================
+static i32 statsCurrent(StatsThread* t) {
+  return atomic_load_explicit(&t->epoch, memory_order_acquire) ==
+         atomic_load_explicit(&g_statsEpoch, memory_order_acquire);
+}
+
+
+
+// ============================================================================
+// Return this thread's counters, creating and registering them on first use.
+// Blocks are never freed, so counts from exited threads are kept.  If
+// statsReset has run since this thread last recorded, it zeroes its own
+// counters first: only the owning thread ever writes them
+// ============================================================================
+static StatsThread* statsThread() {
+  StatsThread* t = t_stats;
+  if (t == NULL) {
+    t = calloc(1, sizeof(StatsThread));
+    if (t == NULL) FATAL(ENOMEM);
+    t->op   = OPNONE;
+    t->inum = -1;
+    t->hint = -1;
+
+    pthread_mutex_lock(&g_statsLock);
+    if (g_statsT0 == 0) g_statsT0 = histNow();
+    atomic_store(&t->epoch, atomic_load(&g_statsEpoch));
+    t->next = g_statsThreads;
+    g_statsThreads = t;
+    pthread_mutex_unlock(&g_statsLock);
+
+    t_stats = t;
+  }
+
+  u32 epoch = atomic_load_explicit(&g_statsEpoch, memory_order_acquire);
+  if (atomic_load_explicit(&t->epoch, memory_order_relaxed) != epoch) {
+    statsZero((u64*)&t->io, sizeof(IOStats) / sizeof(u64));
+    statsZero(&t->heat[0][0], 2 * BLOCKSPERDISK);
+    for (i32 inum = 0; inum < NUMINODES; ++inum) statsZeroFile(&t->file[inum]);
+    for (i32 l = 0; l < NUMLAT; ++l) histReset(&t->lat[l]);
+    atomic_store_explicit(&t->epoch, epoch, memory_order_release);
+  }
+  return t;
+}
+
+
+
+// ============================================================================
+// Count one block taken from the Freelist
+// ============================================================================
+i32 statsAlloc() {
+  StatsThread* t = statsThread();
+  STATSADD(t->io.allocs, 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Count one bio call on block 'dbn' that took 'ns' nanoseconds.  'rw' is
+// IOREAD or IOWRITE.  The block class is the hint left by statsClass, if any;
+// otherwise it is derived from the DBN, with anything beyond the metadata
+// blocks counted as data.  Return the class charged
+// ============================================================================
+i32 statsBio(i32 dbn, i32 rw, u64 ns) {
+  StatsThread* t = statsThread();
+
+  i32 bc = t->hint;
+  t->hint = -1;
+
+  if (bc < 0) {
+    switch (dbn) {
+      case DBNSUPER:  bc = BCSUPER; break;
+      case DBNINODES: bc = BCINODE; break;
+      case DBNDIR:    bc = BCDIR;   break;
+      default:        bc = BCDATA;  break;
+    }
+  }
+
+  STATSADD(t->io.io[t->op][bc][rw], 1);
+  STATSADD(t->heat[dbn][rw], 1);
+  if (t->inum >= 0) STATSADD(t->file[t->inum].bio[rw], 1);
+  histRecord(&t->lat[rw == IOREAD ? LATBIOREAD : LATBIOWRITE], ns);
+  return bc;
+}
+
+
+
+// ============================================================================
+// Count 'numb' bytes moved by fsRead ('rw' IOREAD) or fsWrite (IOWRITE)
+// ============================================================================
+i32 statsBytes(i32 rw, i32 numb) {
+  StatsThread* t = statsThread();
+  STATSADD(t->io.bytes[rw], numb);
+  if (t->inum >= 0) STATSADD(t->file[t->inum].bytes[rw], numb);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Count one lookup in the block cache: a hit if 'hit' is non-zero
+// ============================================================================
+i32 statsCache(i32 hit) {
+  StatsThread* t = statsThread();
+  if (hit) STATSADD(t->io.hits, 1); else STATSADD(t->io.misses, 1);
+  if (t->inum >= 0) {
+    FileStats* f = &t->file[t->inum];
+    if (hit) STATSADD(f->hits, 1); else STATSADD(f->misses, 1);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Tell the accounting that the next bio call touches a block of class 'bc'.
+// Only bfs knows which DBNs are indirect or Freelist blocks
+// ============================================================================
+i32 statsClass(i32 bc) {
+  statsThread()->hint = bc;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the printable name of block class 'bc'
+// ============================================================================
+str statsClassName(i32 bc) {
+  return (bc < 0 || bc >= NUMBC) ? "?" : g_bcNames[bc];
+}
+
+
+
+// ============================================================================
+// Mark entry into fs.h operation 'op'.  Should one fs.h call ever make
+// another, the inner one is charged to the outermost operation.  Return the
+// previous operation, to be handed back to statsLeave
+// ============================================================================
+i32 statsEnter(i32 op) {
+  StatsThread* t = statsThread();
+  i32 prev = t->op;
+  if (prev == OPNONE) {
+    t->op   = op;
+    t->inum = -1;
+    STATSADD(t->io.calls[op], 1);
+    t->t0 = histNow();
+  }
+  PROFENTER(PROFFS, PROFOTHER);
+  return prev;
+}
+
+
+
+// ============================================================================
+// Count one block moved by the bio backend.  Without a block cache, every
+// bio call moves one; with it, only misses and write-backs do
+// ============================================================================
+i32 statsDev(i32 rw) {
+  StatsThread* t = statsThread();
+  STATSADD(t->io.dev[rw], 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Count one error code returned to the caller of an fs.h operation
+// ============================================================================
+i32 statsError() {
+  StatsThread* t = statsThread();
+  STATSADD(t->io.errors, 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Tell the accounting that the current fs.h operation works on file 'inum'.
+// From here to statsLeave, its bio calls, cache lookups and bytes are also
+// charged to that file, as are the call itself and its latency.  Directory
+// lookups made before the file is known are charged to no file
+// ============================================================================
+i32 statsFile(i32 inum) {
+  if (inum < 0 || inum >= NUMINODES) return EBADINUM;
+  statsThread()->inum = inum;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Zero the per-file counters of 'inum', in every thread: the file it held is
+// gone, and a new one is taking its place.  Call with the file system locked:
+// threads charge a file only between statsFile and statsLeave, under that
+// same lock, so none is bumping these meanwhile
+// ============================================================================
+i32 statsForget(i32 inum) {
+  if (inum < 0 || inum >= NUMINODES) return EBADINUM;
+  pthread_mutex_lock(&g_statsLock);
+  for (StatsThread* t = g_statsThreads; t != NULL; t = t->next) {
+    statsZeroFile(&t->file[inum]);
+  }
+  pthread_mutex_unlock(&g_statsLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Count one block returned to the Freelist
+// ============================================================================
+i32 statsFree() {
+  StatsThread* t = statsThread();
+  STATSADD(t->io.frees, 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Sum the bio counters of every thread into 'st'
+// ============================================================================
+i32 statsGet(IOStats* st) {
+  if (st == NULL) FATAL(ENULLPTR);
+  memset(st, 0, sizeof(IOStats));
+
+  pthread_mutex_lock(&g_statsLock);
+  for (StatsThread* t = g_statsThreads; t != NULL; t = t->next) {
+    if (!statsCurrent(t)) continue;
+    for (i32 op = 0; op < NUMOPS; ++op) {
+      st->calls[op] += STATSGET(t->io.calls[op]);
+      for (i32 bc = 0; bc < NUMBC; ++bc) {
+        st->io[op][bc][IOREAD]  += STATSGET(t->io.io[op][bc][IOREAD]);
+        st->io[op][bc][IOWRITE] += STATSGET(t->io.io[op][bc][IOWRITE]);
+      }
+    }
+    st->allocs   += STATSGET(t->io.allocs);
+    st->frees    += STATSGET(t->io.frees);
+    st->bytes[0] += STATSGET(t->io.bytes[0]);
+    st->bytes[1] += STATSGET(t->io.bytes[1]);
+    st->errors   += STATSGET(t->io.errors);
+    st->dev[0]   += STATSGET(t->io.dev[0]);
+    st->dev[1]   += STATSGET(t->io.dev[1]);
+    st->hits     += STATSGET(t->io.hits);
+    st->misses   += STATSGET(t->io.misses);
+  }
+  pthread_mutex_unlock(&g_statsLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Sum every thread's bio calls on DBNs 0 to 'num'-1 into 'reads' and
+// 'writes'.  Return the number of DBNs filled
+// ============================================================================
+i32 statsGetHeat(u64* reads, u64* writes, i32 num) {
+  if (reads == NULL || writes == NULL) FATAL(ENULLPTR);
+  if (num > BLOCKSPERDISK) num = BLOCKSPERDISK;
+  memset(reads,  0, num * sizeof(u64));
+  memset(writes, 0, num * sizeof(u64));
+
+  pthread_mutex_lock(&g_statsLock);
+  for (StatsThread* t = g_statsThreads; t != NULL; t = t->next) {
+    if (!statsCurrent(t)) continue;
+    for (i32 dbn = 0; dbn < num; ++dbn) {
+      reads [dbn] += STATSGET(t->heat[dbn][IOREAD]);
+      writes[dbn] += STATSGET(t->heat[dbn][IOWRITE]);
+    }
+  }
+  pthread_mutex_unlock(&g_statsLock);
+  return num;
+}
+
+
+
+// ============================================================================
+// Merge latency histogram 'lat' (an OPxxx or LATBIOxxx) of every thread
+// into 'h'
+// ============================================================================
+i32 statsGetHist(i32 lat, Hist* h) {
+  if (h == NULL) FATAL(ENULLPTR);
+  histReset(h);
+  if (lat < 0 || lat >= NUMLAT) return 0;
+
+  pthread_mutex_lock(&g_statsLock);
+  for (StatsThread* t = g_statsThreads; t != NULL; t = t->next) {
+    if (statsCurrent(t)) histMerge(h, &t->lat[lat]);
+  }
+  pthread_mutex_unlock(&g_statsLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Copy the name last given to file 'inum' by statsName into 'fname', of at
+// least FNAMESIZE bytes; an empty string if it has none
+// ============================================================================
+i32 statsGetName(i32 inum, str fname) {
+  if (fname == NULL) FATAL(ENULLPTR);
+  fname[0] = 0;
+  if (inum < 0 || inum >= NUMINODES) return EBADINUM;
+  pthread_mutex_lock(&g_statsLock);
+  memcpy(fname, g_statsNames[inum], FNAMESIZE);
+  pthread_mutex_unlock(&g_statsLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the printable name of latency histogram 'lat'
+// ============================================================================
+str statsLatName(i32 lat) {
+  if (lat == LATBIOREAD)  return "bioRead";
+  if (lat == LATBIOWRITE) return "bioWrite";
+  return statsOpName(lat);
+}
+
+
+
+// ============================================================================
+// Mark exit from the current fs.h operation.  'prev' is the value returned
+// by the matching statsEnter.  Leaving the outermost operation records its
+// latency
+// ============================================================================
+i32 statsLeave(i32 prev) {
+  PROFLEAVE();
+  StatsThread* t = statsThread();
+  if (prev == OPNONE && t->op != OPNONE) {
+    u64 ns = histNow() - t->t0;
+    histRecord(&t->lat[t->op], ns);
+    if (t->inum >= 0) {
+      STATSADD(t->file[t->inum].ops[t->op], 1);
+      STATSADD(t->file[t->inum].ns, ns);
+    }
+    t->inum = -1;
+  }
+  t->op = prev;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Remember that file 'inum' is called 'fname', so that readers of the
+// per-file counters can name it without going to the Directory
+// ============================================================================
+i32 statsName(i32 inum, str fname) {
+  if (inum < 0 || inum >= NUMINODES) return EBADINUM;
+  pthread_mutex_lock(&g_statsLock);
+  strncpy(g_statsNames[inum], fname, FNAMESIZE - 1);
+  g_statsNames[inum][FNAMESIZE - 1] = 0;
+  pthread_mutex_unlock(&g_statsLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the fs.h operation this thread is executing; OPNONE if none
+// ============================================================================
+i32 statsOp() {
+  return statsThread()->op;
+}
+
+
+
+// ============================================================================
+// Return the printable name of operation 'op'
+// ============================================================================
+str statsOpName(i32 op) {
+  return (op < 0 || op >= NUMOPS) ? "?" : g_opNames[op];
+}
+
+
+
+// ============================================================================
+// Zero the counters and histograms of every thread.  This only moves the
+// reset epoch on: each thread zeroes its own at its next recording, and
+// until then the readers leave it out, so no thread writes counters that
+// another is bumping
+// ============================================================================
+i32 statsReset() {
+  pthread_mutex_lock(&g_statsLock);
+  g_statsT0 = histNow();
+  atomic_fetch_add(&g_statsEpoch, 1);
+  pthread_mutex_unlock(&g_statsLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return when this thread's outermost fs.h operation began, per histNow: the
+// one running, or, once it has left, the last one
+// ============================================================================
+u64 statsStart() {
+  return statsThread()->t0;
+}
+
+
+
+// ============================================================================
+// Sum every thread's counters into the volume-wide summary 'fs'.  The Open
+// File Table fields are left for the caller, who owns the table
+// ============================================================================
+i32 statsSummary(FsStats* fs) {
+  if (fs == NULL) FATAL(ENULLPTR);
+  memset(fs, 0, sizeof(FsStats));
+
+  IOStats st;
+  statsGet(&st);
+
+  for (i32 op = 0; op < NUMOPS; ++op) {
+    fs->ops[op] = st.calls[op];
+    for (i32 bc = 0; bc < NUMBC; ++bc) {
+      fs->bioReads  += st.io[op][bc][IOREAD];
+      fs->bioWrites += st.io[op][bc][IOWRITE];
+      if (bc != BCDATA) {
+        fs->metaIOs += st.io[op][bc][IOREAD] + st.io[op][bc][IOWRITE];
+      }
+    }
+  }
+  fs->bytesRead    = st.bytes[IOREAD];
+  fs->bytesWritten = st.bytes[IOWRITE];
+  fs->allocs       = st.allocs;
+  fs->frees        = st.frees;
+  fs->errors       = st.errors;
+  fs->devReads     = st.dev[IOREAD];
+  fs->devWrites    = st.dev[IOWRITE];
+  fs->cacheHits    = st.hits;
+  fs->cacheMisses  = st.misses;
+
+  pthread_mutex_lock(&g_statsLock);
+  u64 t0 = g_statsT0;
+  pthread_mutex_unlock(&g_statsLock);
+
+  fs->elapsedNs    = (t0 == 0) ? 0 : histNow() - t0;
+  fs->allocsPerSec = (fs->elapsedNs == 0) ? 0.0
+                   : fs->allocs / (fs->elapsedNs / 1e9);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Sum every thread's per-file counters, and fill 'top' with those of up to
+// 'max' files, busiest first: most bio calls, then most bytes moved.  Files
+// with no fs.h calls charged are left out.  Return the number filled
+// ============================================================================
+i32 statsTopFiles(FileStats* top, i32 max) {
+  if (top == NULL) FATAL(ENULLPTR);
+
+  FileStats all[NUMINODES];
+  memset(all, 0, sizeof(all));
+
+  pthread_mutex_lock(&g_statsLock);
+  for (StatsThread* t = g_statsThreads; t != NULL; t = t->next) {
+    if (!statsCurrent(t)) continue;
+    for (i32 inum = 0; inum < NUMINODES; ++inum) {
+      FileStats* a = &all[inum];
+      FileStats* f = &t->file[inum];
+      for (i32 op = 0; op < NUMOPS; ++op) a->ops[op] += STATSGET(f->ops[op]);
+      for (i32 rw = 0; rw < 2; ++rw) {
+        a->bytes[rw] += STATSGET(f->bytes[rw]);
+        a->bio[rw]   += STATSGET(f->bio[rw]);
+      }
+      a->hits   += STATSGET(f->hits);
+      a->misses += STATSGET(f->misses);
+      a->ns     += STATSGET(f->ns);
+    }
+  }
+  pthread_mutex_unlock(&g_statsLock);
+
+  i32 num = 0;
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    FileStats* a = &all[inum];
+    a->inum = inum;
+    u64 calls = 0;
+    for (i32 op = 0; op < NUMOPS; ++op) calls += a->ops[op];
+    if (calls == 0) continue;
+
+    u64 io    = a->bio[IOREAD] + a->bio[IOWRITE];
+    u64 bytes = a->bytes[IOREAD] + a->bytes[IOWRITE];
+    i32 pos   = num;                          // insertion sort, descending
+    while (pos > 0) {
+      FileStats* p = &all[pos - 1];
+      u64 pio    = p->bio[IOREAD] + p->bio[IOWRITE];
+      u64 pbytes = p->bytes[IOREAD] + p->bytes[IOWRITE];
+      if (pio > io || (pio == io && pbytes >= bytes)) break;
+      --pos;
+    }
+    FileStats cur = *a;
+    memmove(&all[pos + 1], &all[pos], (num - pos) * sizeof(FileStats));
+    all[pos] = cur;
+    ++num;
+  }
+
+  if (num > max) num = max;
+  memcpy(top, all, num * sizeof(FileStats));
+  return num;
+}
@@ -0,0 +1,117 @@
+#ifndef STATS_H
+#define STATS_H
+
+// ===================================================================
+// stats.h - I/O accounting for BFS.  Counts every bioRead/bioWrite,
+// broken down by the role of the block touched, and by the fs.h
+// operation that caused it, and by DBN.  Also keeps a latency
+// histogram for each fs.h operation and for the two bio calls, and
+// per-file counters, to say which file the load comes from.
+//
+// Each thread records into its own block of counters, so recording
+// never takes a lock.  statsGet, statsGetHist and statsSummary sum
+// over all threads
+// ===================================================================
+
+#include "alias.h"
+#include "hist.h"
+
+#define BCSUPER       0   // Block classes: SuperBlock (DBN 0)
+#define BCINODE       1   //   Inodes block (DBN 1)
+#define BCDIR         2   //   Directory block (DBN 2)
+#define BCINDIRECT    3   //   indirect block of some file
+#define BCDATA        4   //   file data block
+#define BCFREE        5   //   block on the Freelist
+#define NUMBC         6
+
+#define OPNONE        0   // Operations: not inside any fs.h call
+#define OPOPEN        1
+#define OPCREATE      2
+#define OPREAD        3
+#define OPWRITE       4
+#define OPSEEK        5
+#define OPCLOSE       6
+#define OPSIZE        7
+#define OPTELL        8
+#define OPFORMAT      9
+#define OPMOUNT       10
+#define OPDELETE      11
+#define NUMOPS        12
+
+#define IOREAD        0
+#define IOWRITE       1
+
+#define LATBIOREAD    NUMOPS        // Latency histograms: one per OPxxx,
+#define LATBIOWRITE   (NUMOPS + 1)  //   plus bioRead and bioWrite
+#define NUMLAT        (NUMOPS + 2)
+
+typedef struct {                    // IOStats
+  u64 calls[NUMOPS];                // # calls of each fs.h operation
+  u64 io[NUMOPS][NUMBC][2];         // bio calls by op, class, IOREAD/IOWRITE
+  u64 allocs;                       // blocks taken from the Freelist
+  u64 frees;                        // blocks returned to the Freelist
+  u64 bytes[2];                     // bytes moved by fsRead and fsWrite
+  u64 errors;                       // error codes returned by fs.h calls
+  u64 dev[2];                       // blocks moved by the bio backend
+  u64 hits;                         // bio calls served by the block cache
+  u64 misses;                       // bio calls that missed the cache
+} IOStats;
+
+typedef struct {                    // FsStats: see fsGetStats
+  u64 ops[NUMOPS];                  // # calls of each fs.h operation
+  u64 bytesRead;                    // bytes returned by fsRead
+  u64 bytesWritten;                 // bytes written by fsWrite
+  u64 bioReads;                     // blocks read from the BFS disk
+  u64 bioWrites;                    // blocks written to the BFS disk
+  u64 metaIOs;                      // ... of which, metadata blocks
+  u64 devReads;                     // blocks the bio backend read
+  u64 devWrites;                    // blocks the bio backend wrote
+  u64 cacheHits;                    // bio calls served by the block cache
+  u64 cacheMisses;                  // bio calls that missed the cache
+  i32 dirty;                        // cached blocks not yet written back
+  u64 allocs;                       // blocks taken from the Freelist
+  u64 frees;                        // blocks returned to the Freelist
+  u64 errors;                       // error codes returned by fs.h calls
+  u64 elapsedNs;                    // since counters started or were reset
+  double allocsPerSec;              // allocs / elapsed
+  i32 oftUsed;                      // Open File Table entries in use
+  i32 oftSize;                      // Open File Table capacity
+} FsStats;
+
+typedef struct {                    // FileStats: I/O on one file, by inum
+  i32 inum;
+  u64 ops[NUMOPS];                  // fs.h calls on it; seeks are OPSEEK
+  u64 bytes[2];                     // bytes read and written by fs.h calls
+  u64 bio[2];                       // bio calls made on its behalf
+  u64 hits;                         // ... of which, served by the cache
+  u64 misses;                       // ... of which, missed the cache
+  u64 ns;                           // time spent in fs.h calls on it
+} FileStats;
+
+i32 statsAlloc  ();
+i32 statsBio    (i32 dbn, i32 rw, u64 ns);
+i32 statsBytes  (i32 rw, i32 numb);
+i32 statsCache  (i32 hit);
+i32 statsClass  (i32 bc);
+str statsClassName(i32 bc);
+i32 statsDev    (i32 rw);
+i32 statsEnter  (i32 op);
+i32 statsError  ();
+i32 statsFile   (i32 inum);
+i32 statsForget (i32 inum);
+i32 statsFree   ();
+i32 statsGet    (IOStats* st);
+i32 statsGetHeat(u64* reads, u64* writes, i32 num);
+i32 statsGetHist(i32 lat, Hist* h);
+i32 statsGetName(i32 inum, str fname);
+str statsLatName(i32 lat);
+i32 statsLeave  (i32 prev);
+i32 statsName   (i32 inum, str fname);
+i32 statsOp     ();
+str statsOpName (i32 op);
+i32 statsReset  ();
+u64 statsStart  ();
+i32 statsSummary(FsStats* fs);
+i32 statsTopFiles(FileStats* top, i32 max);
+
+#endif
@@ -0,0 +1,309 @@
+// ============================================================================
+// stress.c - multi-threaded stress and throughput harness
+// ============================================================================
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bfs.h"
+#include "defrag.h"
+#include "fs.h"
+#include "fsck.h"
+#include "hist.h"
+#include "res.h"
+#include "stress.h"
+
+typedef struct {                        // StressFile: a file and its shadow
+  i32 fd;
+  i32 size;                             // bytes the file should hold
+  i32 max;                              // bytes it may grow to
+  i8  data[STRESSMAX];                  // what it should hold
+  pthread_mutex_t lock;                 // held across seek + read/write
+} StressFile;
+
+typedef struct {                        // StressArg: one stress thread
+  i32           id;
+  i32           priv;                   // has a private file?
+  u32           rand;                   // xorshift32 state; never 0
+  atomic_ulong  ops;                    // operations done
+  atomic_ulong  bytes;                  // bytes read and written
+} StressArg;
+
+static StressFile  g_stressShared[STRESSSHARED];
+static atomic_int  g_stressStop = 0;    // threads finish when set
+static atomic_int  g_stressBad  = 0;    // checks failed, all threads
+
+static i32 g_stressCounts[] = { 1, 2, 4, 8, 16 };   // thread counts tried
+
+
+
+// ============================================================================
+// Record a failed check.  The first few are described
+// ============================================================================
+static void stressFail(i32 id, i32 fd, str what, i32 off, i32 got, i32 want) {
+  if (atomic_fetch_add(&g_stressBad, 1) >= 10) return;
+  printf("STRESS : BAD  : thread %d, fd %d, %s at %d = %d but should be %d \n",
+    id, fd, what, off, got, want);
+}
+
+
+
+// ============================================================================
+// Read the whole of file 'f' and check it against its shadow.  Return the
+// number of bytes read
+// ============================================================================
+static i32 stressVerify(i32 id, StressFile* f) {
+  i8 buf[BYTESPERBLOCK];
+  fsSeek(f->fd, 0, SEEK_SET);
+  i32 off = 0;
+  i32 n   = 0;
+  while ((n = fsRead(f->fd, BYTESPERBLOCK, buf)) > 0) {
+    for (i32 i = 0; i < n; ++i) {
+      if (off + i < f->size && buf[i] == f->data[off + i]) continue;
+      stressFail(id, f->fd, "byte", off + i, buf[i],
+        off + i < f->size ? f->data[off + i] : -1);
+      return off;
+    }
+    off += n;
+  }
+  if (off != f->size) stressFail(id, f->fd, "size", 0, off, f->size);
+  return off;
+}
+
+
+
+// ============================================================================
+// Do one random operation on file 'f', and check what comes back against
+// its shadow: read a random range; write one, perhaps past EOF, leaving a
+// gap that must read as zeroes; seek and tell; or check the size.  Return
+// the number of bytes read or written
+// ============================================================================
+static i32 stressOp(StressArg* arg, StressFile* f) {
+  i8  buf[2 * BYTESPERBLOCK];
+  i32 op  = xorshift(&arg->rand) % 100;
+  i32 len = 1 + xorshift(&arg->rand) % (2 * BYTESPERBLOCK);
+
+  if (op < 40) {                                // read
+    if (f->size == 0) return 0;
+    i32 off = xorshift(&arg->rand) % f->size;
+    fsSeek(f->fd, off, SEEK_SET);
+    i32 n    = fsRead(f->fd, len, buf);
+    i32 want = (len < f->size - off) ? len : f->size - off;
+    if (n != want) stressFail(arg->id, f->fd, "read count", off, n, want);
+    for (i32 i = 0; i < n && i < want; ++i) {
+      if (buf[i] == f->data[off + i]) continue;
+      stressFail(arg->id, f->fd, "byte", off + i, buf[i], f->data[off + i]);
+      break;
+    }
+    return n;
+  }
+
+  if (op < 80) {                                // write
+    i32 off = xorshift(&arg->rand) % (f->size + BYTESPERBLOCK);
+    if (off + len > f->max) len = f->max - off;
+    if (len <= 0) return 0;
+    for (i32 i = 0; i < len; ++i) buf[i] = (i8)(arg->rand + i);
+    fsSeek(f->fd, off, SEEK_SET);
+    fsWrite(f->fd, len, buf);
+    if (off > f->size) memset(f->data + f->size, 0, off - f->size);
+    memcpy(f->data + off, buf, len);
+    if (off + len > f->size) f->size = off + len;
+    return len;
+  }
+
+  if (op < 90) {                                // seek and tell
+    i32 off = xorshift(&arg->rand) % (f->size + 1);
+    fsSeek(f->fd, off, SEEK_SET);
+    i32 curs = fsTell(f->fd);
+    if (curs != off) stressFail(arg->id, f->fd, "cursor", off, curs, off);
+    fsSeek(f->fd, 0, SEEK_END);
+    curs = fsTell(f->fd);
+    if (curs != f->size) stressFail(arg->id, f->fd, "end", 0, curs, f->size);
+    return 0;
+  }
+
+  i32 size = fsSize(f->fd);                     // size
+  if (size != f->size) stressFail(arg->id, f->fd, "size", 0, size, f->size);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of each stress thread.  Until told to stop, pick a file - its own,
+// or one of the shared files, locked for the duration - and do a random
+// operation on it.  Now and then, close its own file and open it again, or
+// delete it and start afresh.  At the end, check its own file whole, and
+// delete it
+// ============================================================================
+static void* stressThread(void* p) {
+  StressArg*  arg = (StressArg*)p;
+  StressFile* own = NULL;
+  char name[FNAMESIZE];
+  sprintf(name, "P%d", arg->id);
+
+  if (arg->priv) {
+    own = calloc(1, sizeof(StressFile));
+    if (own == NULL) FATAL(ENOMEM);
+    own->max = STRESSPRIVMAX;
+    own->fd  = fsCreate(name);
+  }
+
+  while (!atomic_load(&g_stressStop)) {
+    i32 pick = xorshift(&arg->rand) % (2 * STRESSSHARED);
+    i32 n    = 0;
+    if (own != NULL && pick >= STRESSSHARED) {
+      if (xorshift(&arg->rand) % 50 == 0) {   // reopen, or recreate
+        fsClose(own->fd);
+        if (xorshift(&arg->rand) % 4 == 0) {
+          fsDelete(name);
+          own->fd   = fsCreate(name);
+          own->size = 0;
+        } else {
+          own->fd = fsOpen(name);
+        }
+        atomic_fetch_add(&arg->ops, 1);
+        continue;
+      }
+      n = stressOp(arg, own);
+    } else {
+      StressFile* f = &g_stressShared[pick % STRESSSHARED];
+      pthread_mutex_lock(&f->lock);
+      n = stressOp(arg, f);
+      pthread_mutex_unlock(&f->lock);
+    }
+    atomic_fetch_add(&arg->ops, 1);
+    atomic_fetch_add(&arg->bytes, n);
+  }
+
+  if (own != NULL) {
+    stressVerify(arg->id, own);
+    fsClose(own->fd);
+    fsDelete(name);
+    free(own);
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Stress BFS with 1, 2, 4... up to 'maxThreads' threads, for 'secs' seconds
+// at each count.  Every thread checks each read against the shadow copies
+// of the files; calls on a shared file are serialized by that file's lock,
+// so that the seek and the read or write that follows it stay together.
+// Threads beyond the NUMINODES - STRESSSHARED that get a private file work
+// on the shared files alone.  If 'defragRate' is 0 or more, the online
+// defragmenter runs alongside at that rate, and the disk must then pass
+// fsck too.  Print throughput every STRESSTICKMS, then the rate at each
+// thread count against one thread.  Return the number of checks that failed
+// ============================================================================
+i32 stressRun(i32 secs, i32 maxThreads, i32 defragRate) {
+  if (secs < 1)       secs = 1;
+  if (maxThreads < 1) maxThreads = 1;
+  i32 numCounts = sizeof(g_stressCounts) / sizeof(g_stressCounts[0]);
+
+  str oldDisk = bioDisk();
+  bioSetDisk(STRESSDISK);
+  atomic_store(&g_stressBad, 0);
+
+  double rate[sizeof(g_stressCounts) / sizeof(g_stressCounts[0])];
+  double mbps[sizeof(g_stressCounts) / sizeof(g_stressCounts[0])];
+  i32    ran = 0;
+
+  for (i32 c = 0; c < numCounts && g_stressCounts[c] <= maxThreads; ++c) {
+    i32 threads = g_stressCounts[c];
+    fsFormat();
+    fsMount();
+
+    for (i32 s = 0; s < STRESSSHARED; ++s) {
+      char name[FNAMESIZE];
+      sprintf(name, "S%d", s);
+      StressFile* f = &g_stressShared[s];
+      f->fd   = fsCreate(name);
+      f->size = 0;
+      f->max  = STRESSMAX;
+      pthread_mutex_init(&f->lock, NULL);
+    }
+
+    StressArg* arg = calloc(threads, sizeof(StressArg));
+    pthread_t* tid = calloc(threads, sizeof(pthread_t));
+    if (arg == NULL || tid == NULL) FATAL(ENOMEM);
+
+    atomic_store(&g_stressStop, 0);
+    u64 t0 = histNow();
+    for (i32 t = 0; t < threads; ++t) {
+      arg[t].id   = t;
+      arg[t].priv = (t < NUMINODES - STRESSSHARED);
+      arg[t].rand = 0x9E3779B1u * (t + 1);
+      pthread_create(&tid[t], NULL, stressThread, &arg[t]);
+    }
+    if (defragRate >= 0) defragStart(defragRate);
+
+    printf("\n%d thread(s) \n", threads);
+    u64 lastOps = 0;
+    u64 last    = t0;
+    for (i32 ms = 0; ms < secs * 1000; ms += STRESSTICKMS) {
+      histSleep(STRESSTICKMS);
+      u64 ops = 0;
+      for (i32 t = 0; t < threads; ++t) ops += atomic_load(&arg[t].ops);
+      u64 now = histNow();
+      printf("  %6.1fs %10.0f ops/s \n", (now - t0) / 1e9,
+        (ops - lastOps) / ((now - last) / 1e9));
+      fflush(stdout);
+      lastOps = ops;
+      last    = now;
+    }
+
+    DefragReport defrag;
+    if (defragRate >= 0) defragStop(&defrag);
+    atomic_store(&g_stressStop, 1);
+    for (i32 t = 0; t < threads; ++t) pthread_join(tid[t], NULL);
+    double secsRun = (histNow() - t0) / 1e9;
+
+    u64 ops   = 0;
+    u64 bytes = 0;
+    for (i32 t = 0; t < threads; ++t) {
+      ops   += atomic_load(&arg[t].ops);
+      bytes += atomic_load(&arg[t].bytes);
+    }
+    for (i32 s = 0; s < STRESSSHARED; ++s) {
+      stressVerify(-1, &g_stressShared[s]);
+      fsClose(g_stressShared[s].fd);
+      pthread_mutex_destroy(&g_stressShared[s].lock);
+    }
+    if (defragRate >= 0) {
+      printf("  defrag: %d blocks moved, in %d files \n", defrag.blocks,
+        defrag.moved);
+      FsckReport check;
+      atomic_fetch_add(&g_stressBad, fsckRun(0, &check));
+    }
+
+    rate[ran] = ops / secsRun;
+    mbps[ran] = bytes / secsRun / 1e6;
+    char config[RESNAMESIZE];
+    sprintf(config, "t%d", threads);
+    resAdd("stress", config, "ops-per-s",   RESHIGHER, rate[ran]);
+    resAdd("stress", config, "mb-per-s",    RESHIGHER, mbps[ran]);
+    ++ran;
+
+    free(arg);
+    free(tid);
+  }
+
+  printf("\n%7s %12s %9s %8s %10s \n", "threads", "ops/s", "MB/s",
+    "speedup", "efficiency");
+  for (i32 c = 0; c < ran; ++c) {
+    double up = rate[c] / rate[0];
+    printf("%7d %12.0f %9.2f %7.2fx %9.0f%% \n", g_stressCounts[c], rate[c],
+      mbps[c], up, 100.0 * up / g_stressCounts[c]);
+  }
+
+  i32 bad = atomic_load(&g_stressBad);
+  printf("STRESS : %s : %d check(s) failed \n\n", bad ? "BAD " : "GOOD", bad);
+  fflush(stdout);
+
+  remove(STRESSDISK);
+  bioSetDisk(oldDisk);
+  return bad;
+}
@@ -0,0 +1,24 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+// ===================================================================
+// stress.h - multi-threaded stress and throughput harness.  Threads
+// read, write, seek, reopen and recreate files - some shared by all,
+// one private to each - and check every byte read against a shadow
+// copy of what each file should hold.  It runs at several thread
+// counts and reports throughput as it goes, to show where it stops
+// scaling.  It can run the online defragmenter alongside, to check
+// that moving blocks under live readers and writers loses nothing
+// ===================================================================
+
+#include "alias.h"
+
+#define STRESSDISK    "STRESSDISK"
+#define STRESSSHARED  2                       // files shared by all threads
+#define STRESSPRIVMAX (5 * 512)               // bytes: NUMDIRECT blocks
+#define STRESSMAX     (16 * 512)              // bytes in a shared file
+#define STRESSTICKMS  500                     // progress report interval
+
+i32 stressRun(i32 secs, i32 maxThreads, i32 defragRate);
+
+#endif
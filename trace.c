@@ -0,0 +1,209 @@
+// ============================================================================
+// trace.c - fs.h call trace recording and replay
+// ============================================================================
+
+#include <pthread.h>
+
+#include "bfs.h"
+#include "fs.h"
+#include "hist.h"
+#include "stats.h"
+#include "trace.h"
+
+#define TRACEMAXFD    64          // recorded fds are small: inum + INUMTOFD
+
+static FILE*           g_traceFp = NULL;      // NULL => tracing is off
+static u64             g_traceT0 = 0;         // histNow() at traceStart
+static pthread_mutex_t g_traceLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+// ============================================================================
+// Append one record for fs.h call 'op' to the trace, if tracing is on.  Only
+// calls made by the application are recorded: a call nested inside another
+// fs.h call, should there ever be one, is skipped, since replaying the outer
+// call repeats it.  'fname' is the file name for open/create/delete, else
+// NULL.  The record is stamped with the time the call began, not ended, as
+// a replay must issue it then
+// ============================================================================
+i32 traceOp(i32 op, i32 fd, i32 offset, i32 len, i32 ret, str fname) {
+  if (g_traceFp == NULL) return 0;
+  if (statsOp() != OPNONE) return 0;
+
+  TraceRec rec;
+  rec.op     = (u8)op;
+  rec.nlen   = (fname == NULL) ? 0 : (u8)strlen(fname);
+  rec.fd     = (i16)fd;
+  rec.offset = offset;
+  rec.len    = len;
+  rec.ret    = ret;
+  u64 start  = statsStart();                  // already left: statsOp()
+  rec.ns     = (start > g_traceT0) ? start - g_traceT0 : 0;
+
+  pthread_mutex_lock(&g_traceLock);
+  if (g_traceFp != NULL) {
+    fwrite(&rec, sizeof(TraceRec), 1, g_traceFp);
+    if (rec.nlen > 0) fwrite(fname, 1, rec.nlen, g_traceFp);
+  }
+  pthread_mutex_unlock(&g_traceLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Replay the trace in file 'path' against the current BFS disk (see
+// bioSetDisk).  If 'timed' is non-zero, wait between calls to reproduce the
+// original timing; otherwise run as fast as possible.  Data written is a
+// fixed pattern, since traces do not hold file contents.  Recorded fds are
+// mapped to the fds this disk hands out.  Return # calls replayed
+// ============================================================================
+i32 traceReplay(str path, i32 timed) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) FATAL(ENODISK);
+
+  TraceHeader hdr;
+  if (fread(&hdr, sizeof(TraceHeader), 1, fp) != 1 ||
+      hdr.magic != TRACEMAGIC || hdr.version != TRACEVERSION) {
+    fclose(fp);
+    FATAL(EBADREAD);
+  }
+
+  i32 fdmap[TRACEMAXFD];                      // recorded fd => replay fd
+  for (i32 i = 0; i < TRACEMAXFD; ++i) fdmap[i] = -1;
+
+  i8 buf[BYTESPERBLOCK * 8];
+  i8* data = buf;
+  i32 cap  = sizeof(buf);
+  memset(buf, 0x5A, sizeof(buf));
+
+  TraceRec rec;
+  char fname[256];
+  i32 numOps = 0;
+  i32 created = 0;                            // opens turned into creates
+  u64 t0 = histNow();
+
+  while (fread(&rec, sizeof(TraceRec), 1, fp) == 1) {
+    fname[0] = '\0';
+    if (rec.nlen > 0) {
+      if (fread(fname, 1, rec.nlen, fp) != rec.nlen) break;
+      fname[rec.nlen] = '\0';
+    }
+
+    if (timed) {                              // wait for the recorded time
+      u64 now = histNow() - t0;
+      if (rec.ns > now) {
+        histSleepNs(rec.ns - now);
+      }
+    }
+
+    i32 fd = (rec.fd >= 0 && rec.fd < TRACEMAXFD) ? fdmap[rec.fd] : -1;
+
+    if (rec.len > cap && (rec.op == OPREAD || rec.op == OPWRITE)) {
+      if (data != buf) free(data);
+      data = malloc(rec.len);
+      if (data == NULL) FATAL(ENOMEM);
+      memset(data, 0x5A, rec.len);
+      cap = rec.len;
+    }
+
+    switch (rec.op) {
+      case OPOPEN:
+      case OPCREATE: {
+        if (rec.ret < 0) break;               // failed when recorded
+        i32 newFd = (rec.op == OPOPEN) ? fsOpen(fname) : EFNF;
+        if (newFd == EFNF) {
+          newFd = fsCreate(fname);
+          if (rec.op == OPOPEN) ++created;
+        }
+        if (rec.fd >= 0 && rec.fd < TRACEMAXFD) fdmap[rec.fd] = newFd;
+        break;
+      }
+      case OPREAD:
+        if (fd < 0) break;
+        bfsSetCursor(bfsFdToInum(fd), rec.offset);
+        fsRead(fd, rec.len, data);
+        break;
+      case OPWRITE:
+        if (fd < 0) break;
+        bfsSetCursor(bfsFdToInum(fd), rec.offset);
+        fsWrite(fd, rec.len, data);
+        break;
+      case OPSEEK:
+        if (fd >= 0) fsSeek(fd, rec.offset, rec.len);
+        break;
+      case OPCLOSE:
+        if (fd >= 0) fsClose(fd);
+        if (rec.fd >= 0 && rec.fd < TRACEMAXFD) fdmap[rec.fd] = -1;
+        break;
+      case OPSIZE:
+        if (fd >= 0) fsSize(fd);
+        break;
+      case OPTELL:
+        if (fd >= 0) fsTell(fd);
+        break;
+      case OPFORMAT:
+        fsFormat();
+        break;
+      case OPMOUNT:
+        fsMount();
+        break;
+      case OPDELETE:
+        fsDelete(fname);
+        break;
+      default:
+        continue;                             // unknown: skip
+    }
+    ++numOps;
+  }
+
+  if (data != buf) free(data);
+  fclose(fp);
+
+  double secs = (histNow() - t0) / 1e9;
+  printf("\nreplayed %d calls from %s in %.3f s (%.0f calls/s)%s \n",
+    numOps, path, secs, secs > 0 ? numOps / secs : 0.0,
+    timed ? ", original timing" : "");
+  if (created > 0) printf("%d fsOpen(s) created a missing file \n", created);
+  fflush(stdout);
+
+  return numOps;
+}
+
+
+
+// ============================================================================
+// Start recording every fs.h call into a new trace file 'path'
+// ============================================================================
+i32 traceStart(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) FATAL(EDISKCREATE);
+
+  TraceHeader hdr = { TRACEMAGIC, TRACEVERSION };
+  fwrite(&hdr, sizeof(TraceHeader), 1, fp);
+
+  pthread_mutex_lock(&g_traceLock);
+  g_traceT0 = histNow();
+  g_traceFp = fp;
+  pthread_mutex_unlock(&g_traceLock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop recording, and flush and close the trace file
+// ============================================================================
+i32 traceStop() {
+  pthread_mutex_lock(&g_traceLock);
+  FILE* fp = g_traceFp;
+  g_traceFp = NULL;
+  pthread_mutex_unlock(&g_traceLock);
+
+  if (fp != NULL) fclose(fp);
+  return 0;
+}
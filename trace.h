@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// ===================================================================
+// trace.h - record every fs.h call into a compact binary trace file,
+// and replay such a trace against any BFS disk image.
+//
+// File layout: one TraceHeader, then one TraceRec per call.  A record
+// for fsOpen, fsCreate or fsDelete is followed by 'nlen' bytes of
+// file name
+// ===================================================================
+
+#include "alias.h"
+
+#define TRACEMAGIC    0x43525442  // "BTRC"
+#define TRACEVERSION  1
+
+typedef struct {          // TraceHeader
+  u32 magic;              // TRACEMAGIC
+  u32 version;            // TRACEVERSION
+} TraceHeader;
+
+typedef struct {          // TraceRec
+  u8  op;                 // OPxxx, from stats.h
+  u8  nlen;               // # bytes of file name that follow
+  i16 fd;                 // file descriptor (for open/create: the result)
+  i32 offset;             // read/write: cursor; seek: offset
+  i32 len;                // read/write: numb;   seek: whence
+  i32 ret;                // value returned to the caller
+  u64 ns;                 // nanoseconds since traceStart, at call entry
+} TraceRec;
+
+i32 traceOp    (i32 op, i32 fd, i32 offset, i32 len, i32 ret, str fname);
+i32 traceReplay(str path, i32 timed);
+i32 traceStart (str path);
+i32 traceStop  ();
+
+#endif